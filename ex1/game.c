@@ -23,242 +23,974 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
 
 /* Global definitions */
 #define NUM_CHILDREN               6
+#define MAX_PILES                  8
+#define MAX_REMOVALS               8
+#define MAX_MOVES                  (MAX_PILES * MAX_REMOVALS)
 #define ERROR(...)                 { fprintf(stderr, __VA_ARGS__); }
 #define ERROR_EXIT(...)            { ERROR(__VA_ARGS__); exit(EXIT_FAILURE); }
-#define CAN_REMOVE_RED(node, x)    ((node)->r >= (x))
-#define CAN_REMOVE_GRN(node, x)    ((node)->g >= (x))
-#define CAN_REMOVE_YLO(node, x)    ((node)->y >= (x))
+#define NODE_PILE(node, p)         (*(((p) == 0) ? &(node)->r : \
+		                    ((p) == 1) ? &(node)->g : &(node)->y))
 #define MAXIMIZING_PLAYER(node)    ((node)->depth % 2 == 0)
+#define LAST_MOVED_MAX(node)       ((node)->depth % 2 == 1)
 #define MIN(x,y)                   (((x) < (y)) ? (x) : (y))
 #define MAX(x,y)                   (((x) > (y)) ? (x) : (y))
-#define MAX_WINNING_VALUE          (3*M+1)
+#define MAX_WINNING_VALUE          ((int) (3*M+1))
 #define MIN_WINNING_VALUE          ((-1)*MAX_WINNING_VALUE)
 #define STATE_COST(node)           calculate_state_cost(node)
-#define PRINT_MENU_OPTION(x,n,c)   printf("\t%d: Remove %d %s\n", x, n, c)
-#define IS_FINAL_STATE(node)       ((node)->r + (node)->g + (node)->y == 0)
+#define PRINT_MENU_OPTION(x,n,c)   printf("\t%d: Remove %lld %s\n", x, (long long) (n), c)
+#define IS_FINAL_STATE(node)       (((node)->r | (node)->g | (node)->y) == 0)
+#define MAX_SEARCH_M               (INT_MAX/3 - 1)
+#define MAX_BOARD_TOKENS           1000
 #define VALID_OPTION(x)            options[x]
+#define USAGE                      "USAGE: %s [-e minimax|alphabeta|tt|retro|grundy|" \
+		                   "parallel|deepening|mcts] [-p optimal|nonoptimal] " \
+		                   "[-j THREADS] [-t MSEC] [-i ITERATIONS] [-f TABLE] [-c] " \
+		                   "[-g GAMES [-o optimal|greedy|random|script:FILE] " \
+		                   "[-s SEED]] [-b] M K1 K2 K3\n" \
+		                   "       %s -v SET/SET[/...] M\n" \
+		                   "       %s -w [-j THREADS] M[-M] K1[-K1] K2[-K2] K3[-K3]\n"
+#define TABLE_MAGIC                "GAMETBL1"
+#define DEFAULT_ENGINE             ((min_optimal) ? GRUNDY : TRANSPOSITION)
+#define POLICY_CONCAT(name, suffix) name##_##suffix
+#define POLICY_EXPAND(name, suffix) POLICY_CONCAT(name, suffix)
+#define POLICY(name)               POLICY_EXPAND(name, POLICY_SUFFIX)
+#define POLICY_CALL(name, ...)     ((min_optimal) ? name##_optimal(__VA_ARGS__) : \
+		                    name##_nonoptimal(__VA_ARGS__))
+#define GRUNDY_VALUE(s, n)         (!(s)->values ? SUBTRACTION_1K((s)->k, n) : \
+		(n) < (s)->preperiod + (s)->period ? (s)->values[n] : \
+		(s)->values[(s)->preperiod + ((n) - (s)->preperiod) % (s)->period])
+/* Grundy value of n for the moves {1, k} */
+#define SUBTRACTION_1K(k, n)       (((k) & 1) ? (int) ((n) & 1) : \
+		((n) % ((k)+1) == (k)) ? 2 : (int) (((n) % ((k)+1)) & 1))
+#define NIM_SUM(node)              (GRUNDY_VALUE(grundy[0], (node)->r) ^ \
+		                    GRUNDY_VALUE(grundy[1], (node)->g) ^ \
+		                    GRUNDY_VALUE(grundy[2], (node)->y))
+#define GRUNDY_HASH_BASE           1099511628211ULL
+#define NUM_ENGINES                (MCTS + 1)
+#define ENGINE_USES_TREE(e)        ((e) == MINIMAX || (e) == ALPHA_BETA)
+#define FIELD_BITS                 16
+#define FIELD_MASK                 ((1ULL << FIELD_BITS) - 1)
+/* Node values, up to 3*M+1, are cached in a short */
+#define MAX_TREE_M                 ((int) (SHRT_MAX / 3))
+#define TREE_NO_VALUE              SHRT_MIN
+/*
+ * parallel_search() recurses once per ply, on threads with stacks of
+ * PARALLEL_STACK_SIZE. A ply takes at most PARALLEL_PLY_STACK bytes: a
+ * parallel_search() frame and, if the node is split, the frames of
+ * split_search(), wait_split() and run_task() (about 550 B with -O2).
+ */
+#define PARALLEL_STACK_SIZE        ((size_t) 64 << 20)
+#define PARALLEL_PLY_STACK         1024
+#define MAX_PARALLEL_M             ((int) (PARALLEL_STACK_SIZE / \
+		                    (3 * PARALLEL_PLY_STACK)) - 1)
+#define PACK_STATE(node)           ((uint64_t) (node)->r | \
+		                    (uint64_t) (node)->g << FIELD_BITS | \
+		                    (uint64_t) (node)->y << 2*FIELD_BITS | \
+		                    (uint64_t) (node)->depth << 3*FIELD_BITS)
+#define FINAL_STATE(state)         (((state) & ((1ULL << 3*FIELD_BITS) - 1)) == 0)
+#define TREE_DEPTH(t)              ((int) ((t)->state >> 3*FIELD_BITS))
+#define HAS_MOVE(t, i)             (((t)->moves >> (i)) & 1)
+#define CHILD_INDEX(t, i)          ((t)->children + \
+		__builtin_popcount((t)->moves & ((1U << (i)) - 1)))
+#define TOKENS(node)               ((node)->r + (node)->g + (node)->y)
+#define SPLIT_MIN_TOKENS           8
+#define ABORTED(split)             (split_aborted(split))
+#define DEFAULT_MOVE_BUDGET        1000
+#define DEADLINE_CHECK_NODES       1024
+#define MCTS_BITS                  21
+#define MCTS_MASK                  ((1ULL << MCTS_BITS) - 1)
+#define MAX_MCTS_M                 ((int) MCTS_MASK)
+#define MCTS_PILE(state, p)        (((state) >> (p) * MCTS_BITS) & MCTS_MASK)
+#define MCTS_EXPLORATION           1.41421356
+#define DEFAULT_ITERATIONS         20000
+/* A playout removes at most 3*M tokens: the default budget, per move */
+#define DEFAULT_PLAYOUT_TOKENS     10000000L
+#define DEADLINE_CHECK_PLIES       16384
+#define ELAPSED_NS(a, b)           (((b).tv_sec - (a).tv_sec) * 1000000000L + \
+		                    ((b).tv_nsec - (a).tv_nsec))
+#define LATENCY_BUCKETS            1024
+#define SWEEP_CHUNK                4096
+#define SWEEP_INVALID              (-1)
+/* A sweep result: the winner in bit 3 (set if MAX) and the opening move */
+#define SWEEP_RESULT(max_wins, m)  ((signed char) ((max_wins) << 3 | (m)))
+/* Log-linear histogram bucket of a latency: 16 buckets per power of 2 */
+#define LATENCY_BUCKET(ns)         (((ns) < 16) ? (int) (ns) : \
+		(60 - __builtin_clzl(ns)) * 16 + \
+		(int) (((ns) >> (59 - __builtin_clzl(ns))) & 15))
+#define BUCKET_LATENCY(b)          (((b) < 16) ? (long) (b) : \
+		(long) (16 + (b) % 16) << ((b) / 16 - 1))
+#define STATS_DEPTHS               64
+#ifdef SEARCH_STATS
+#define STAT_ADD(counter, n)       __atomic_fetch_add(&search_stats.counter, (n), \
+		                    __ATOMIC_RELAXED)
+/* Visits of nodes STATS_DEPTHS-1 or more plies deep share the last counter */
+#define STAT_VISIT(depth)          { STAT_ADD(nodes_visited, 1); \
+		STAT_ADD(depth_visits[MIN((depth), STATS_DEPTHS-1)], 1); }
+#else
+#define STAT_ADD(counter, n)
+#define STAT_VISIT(depth)
+#endif
+/* Engines whose moves only read shared data, and can play games in parallel */
+#define ENGINE_IS_REENTRANT(e)     ((e) == GRUNDY || (e) == RETROGRADE)
+#define TT_EMPTY                   SHRT_MIN
+#define TT_SIZE                    ((size_t) (M+1) * (M+1) * (M+1) * 2)
+#define TT_INDEX(node)             (((((size_t) (node)->r * (M+1) + (node)->g) \
+		* (M+1) + (node)->y) << 1) | ((node)->depth & 1))
+/* Orders two interchangeable piles, as a comparator of a sorting network */
+#define SORT_PILES(a, b)           { if ((a) > (b)) { pile_t t = (a); (a) = (b); (b) = t; } }
+/* Re-expresses a value computed at depth 'from' for a node at depth 'to' */
+#define ADJUST_VALUE(v, from, to)  (((v) > 0) ? (v) - ((to) - (from)) : \
+		((v) < 0) ? (v) + ((to) - (from)) : 0)
+
+typedef enum engine_e engine_t;
+enum engine_e {MINIMAX, ALPHA_BETA, TRANSPOSITION, RETROGRADE, GRUNDY,
+	PARALLEL, DEEPENING, MCTS};
+
+/* Header of an outcome table file, followed by TT_SIZE shorts */
+typedef struct table_header_s table_header_t;
+struct table_header_s {
+	char     magic[8];
+	int32_t  m, k1, k2, k3;
+	int32_t  min_policy;
+	int32_t  reserved;
+	uint64_t entries;
+};
+
+typedef enum agent_e agent_t;
+enum agent_e {OPTIMAL_AGENT, GREEDY_AGENT, RANDOM_AGENT, SCRIPT_AGENT};
 
+typedef long long pile_t;
+
+/* A position: the three piles and the number of moves played so far */
 typedef struct node_s node_t;
 struct node_s {
-	int r;
-	int g;
-	int y;
+	pile_t r;
+	pile_t g;
+	pile_t y;
 	int depth;
-	node_t *children[NUM_CHILDREN];
-	node_t *parent;
+};
+
+/*
+ * Game tree node: the position packed in 16-bit fields, its legal moves
+ * as a bitmask and, once expanded, the index of its first child. The
+ * children of a node are stored next to each other in tree[], in move
+ * order, so the child of move i is found by counting the moves below i.
+ * value caches the exact minimax value of the node once a search has
+ * found it, so that later turns do not search the subtree again.
+ */
+typedef struct tree_node_s tree_node_t;
+struct tree_node_s {
+	uint64_t state;
+	uint32_t children;
+	uint8_t  moves;
+	uint8_t  expanded;
+	short    value;
+};
+
+/*
+ * Grundy sequence of a pile whose moves remove moves[0..size) tokens,
+ * the largest being k: values[n] for n in [0, preperiod + period),
+ * periodic with the given period afterwards. values is NULL for the
+ * moves {1, k}, whose values SUBTRACTION_1K() computes.
+ */
+typedef struct grundy_seq_s grundy_seq_t;
+struct grundy_seq_s {
+	pile_t        *moves;
+	int            size;
+	pile_t         k;
+	pile_t         preperiod;
+	pile_t         period;
+	unsigned char *values;
+};
+
+/*
+ * A node whose remaining moves are searched by several workers. It lives
+ * on the stack of the worker that created it, which waits until every
+ * task of the split has completed.
+ */
+typedef struct worker_s worker_t;
+typedef struct split_s split_t;
+struct split_s {
+	pthread_mutex_t lock;
+	split_t        *parent;
+	node_t          node;
+	int             alpha;
+	int             beta;
+	int             bestvalue;
+	int             minimizing;
+	int             pending;
+	int             cutoff;
+	int             is_root;
+	int             values[NUM_CHILDREN];
+	int           (*search)(node_t *node, int alpha, int beta,
+			split_t *parent, worker_t *worker);
+};
+
+/* Searching one move of a split node */
+typedef struct task_s task_t;
+struct task_s {
+	split_t *split;
+	int      move;
+};
+
+/*
+ * Per-thread deque of tasks: its owner pushes and pops at the tail,
+ * idle workers steal from the head.
+ */
+struct worker_s {
+	pthread_t       thread;
+	pthread_mutex_t lock;
+	task_t         *tasks;
+	int             head;
+	int             tail;
+	int             capacity;
+	int             id;
+};
+
+/*
+ * A node on the explicit stack of minimax() and alphabeta(): its window,
+ * the window it was entered with, its best value so far and the moves
+ * left to search, order[k] onwards.
+ */
+typedef struct search_frame_s search_frame_t;
+struct search_frame_s {
+	uint32_t index;
+	int      depth;
+	int      alpha;
+	int      beta;
+	int      lower;
+	int      upper;
+	int      bestvalue;
+	int      minimizing;
+	int      k;
+	int      order[NUM_CHILDREN];
+	node_t   node;
+	short   *entry;
+};
+
+/*
+ * Monte Carlo tree node: the three piles packed in MCTS_BITS-bit
+ * fields, its legal moves and, once expanded, the index of its first
+ * child, as in tree[]. wins counts the playouts through the node won
+ * by the player who moved to it.
+ */
+typedef struct mcts_node_s mcts_node_t;
+struct mcts_node_s {
+	uint64_t state;
+	uint32_t children;
+	uint32_t visits;
+	float    wins;
+	uint8_t  moves;
+};
+
+/*
+ * The tree of one MCTS thread. Threads search the same root on trees
+ * of their own, whose root statistics are summed up in the end.
+ */
+typedef struct mcts_s mcts_t;
+struct mcts_s {
+	pthread_t    thread;
+	mcts_node_t *nodes;
+	uint32_t     size;
+	uint32_t     capacity;
+	uint32_t    *path;
+	uint64_t     rng;
+	long         iterations;
+	int          depth;
+};
+
+/* Counters kept by a build with SEARCH_STATS defined */
+typedef struct search_stats_s search_stats_t;
+struct search_stats_s {
+	long nodes_created;
+	long nodes_visited;
+	long illegal_moves;
+	long terminal_evaluations;
+	long table_hits;
+	long cutoffs;
+	long depth_visits[STATS_DEPTHS];
+};
+
+/*
+ * Grundy sequence of a pile with moves {1, k}, shared by every
+ * configuration of a sweep with k among its K values.
+ */
+typedef struct sweep_pile_s sweep_pile_t;
+struct sweep_pile_s {
+	grundy_seq_t seq;
+	pile_t       moves[2];
+	int          used;
+};
+
+/* Outcomes and MAX move latencies of the games played by one thread */
+typedef struct play_stats_s play_stats_t;
+struct play_stats_s {
+	pthread_t thread;
+	long      latencies[LATENCY_BUCKETS];
+	long      latency_sum;
+	long      moves;
+	long      max_wins;
+	long      plies;
+	long      won_positions;
+	long      kept_wins;
 };
 
 /* Function Prototypes */
-void    get_args(char **argv);
-node_t *build_game_tree(void);
-void    build_next_level(node_t *node);
-node_t *alloc_tree_node(node_t *parent);
-node_t *create_state(node_t *parent, int caseno);
+void    get_args(int argc, char **argv);
+void    prepare_engine(void);
+uint32_t build_game_tree(node_t *node);
+void    build_next_level(uint32_t index);
+uint32_t alloc_tree_nodes(int count);
+void    unpack_state(uint64_t state, node_t *node);
+int     legal_move(node_t *node, int caseno);
+int     apply_move(node_t *node, int caseno);
+uint32_t advance(uint32_t index, int caseno);
 void    play_game(void);
 void    print_board(node_t *node);
 void    print_options(node_t *node);
-int     minimax(node_t *node);
+void    parse_variant(char *spec);
+void    build_move_table(void);
+void    build_classic_moves(void);
+void    play_variant(void);
+void    print_variant(pile_t *piles);
+int     variant_nim_sum(pile_t *piles);
+int     variant_move(pile_t *piles);
+void    order_moves(uint32_t index, int *order);
+int     mirror_move(node_t *node, int caseno);
+void    canonical_position(node_t *node);
+void    alloc_search_stack(int frames);
+void    decide_max_move(node_t *node);
+void    order_positions(node_t *node, int *order);
+void    start_workers(void);
+void    stop_workers(void);
+void   *worker_loop(void *arg);
+void   *root_loop(void *arg);
+void    push_task(worker_t *worker, split_t *split, int move);
+int     take_task(worker_t *worker, split_t *split, task_t *task);
+void    run_task(worker_t *worker, task_t *task);
+void    wait_split(worker_t *worker, split_t *split);
+int     split_aborted(split_t *split);
+int     split_descends(split_t *split, split_t *ancestor);
+void    parallel_root(node_t *node);
+void    deepening_move(node_t *node);
+int     past_deadline(void);
+void    alloc_mcts(void);
+void    mcts_move(node_t *node);
+void   *mcts_worker(void *arg);
+int     mcts_iteration(mcts_t *search);
+int     mcts_moves(uint64_t state);
+int     mcts_playout(mcts_t *search, uint64_t state, int side);
+uint64_t mcts_random(mcts_t *search);
+void    alloc_transposition_table(void);
+void    retrograde_analysis(void);
+int     load_outcome_table(char *path);
+void    save_outcome_table(char *path);
+void    compute_grundy_values(void);
+void    detect_grundy_period(grundy_seq_t *seq);
+pile_t  parse_pile(char *arg);
+void    print_pile(pile_t n, char *color);
+void    grundy_move(node_t *node);
+int     check_grundy(void);
 int     calculate_state_cost(node_t *node);
+int     evaluate_state(node_t *node);
 int     read_option(void);
+void    run_tournament(void);
+void   *tournament_worker(void *arg);
+void    play_headless(play_stats_t *stats, int game);
+int     agent_move(node_t *node, int turn, unsigned int *seed);
+void    load_script(char *path);
+void    run_bench(void);
+double  count_tree_nodes(double limit);
+void    parse_range(char *arg, pile_t *lo, pile_t *hi);
+void    run_sweep(void);
+void    run_sweep_threads(void *(*worker)(void *));
+void   *sweep_grundy_worker(void *arg);
+void   *sweep_worker(void *arg);
+int     sweep_config(long index);
+void    print_search_stats(void);
 void    free_memory(void);
-void    free_game_tree(node_t *root);
+void    free_game_tree(void);
+
+#define POLICY_PROTOTYPES
+#define POLICY_SUFFIX              optimal
+#include "search.h"
+#undef  POLICY_SUFFIX
+#define POLICY_SUFFIX              nonoptimal
+#include "search.h"
+#undef  POLICY_SUFFIX
+#undef  POLICY_PROTOTYPES
 
 /* Global Data */
-int     M, K1, K2, K3;
-node_t *root;
-int     options[NUM_CHILDREN],
-	next_max_choice = -1;
+pile_t  M, K1, K2, K3;
+uint32_t root;
+tree_node_t *tree,
+	*spare_tree;
+uint32_t tree_size,
+	 tree_capacity,
+	 spare_capacity;
+int     options[MAX_MOVES],
+	*killer;
+search_frame_t *search_stack;
+int     search_stack_size;
+__thread int next_max_choice = -1;
+short  *tt;
+void   *tt_mapping;
+size_t  tt_mapping_size;
+char   *table_path;
+grundy_seq_t *grundy[MAX_PILES];
+char   *variant_spec;
+int     num_piles = 3,
+	num_moves = NUM_CHILDREN,
+	removal_count[MAX_PILES],
+	pile_class[MAX_PILES],
+	pile_move[MAX_PILES][MAX_REMOVALS],
+	move_pile[MAX_MOVES],
+	move_rank[MAX_MOVES];
+pile_t  removals[MAX_PILES][MAX_REMOVALS],
+	move_amount[MAX_MOVES];
+char   *pile_colors[MAX_PILES] = {"\x1B[31m", "\x1B[32m", "\x1B[33m",
+	"\x1B[34m", "\x1B[35m", "\x1B[36m", "\x1B[37m", "\x1B[90m"};
+char   *pile_names[MAX_PILES] = {"RED", "GREEN", "YELLOW", "BLUE",
+	"MAGENTA", "CYAN", "WHITE", "GRAY"};
+int     check_mode,
+	bench_mode;
+char   *engine_names[] = {"minimax", "alphabeta", "tt", "retro", "grundy",
+	"parallel", "deepening", "mcts"};
+search_stats_t search_stats;
+engine_t engine;
+int     min_optimal = 1;
+int     symmetric_piles;
+worker_t *workers;
+int     num_workers,
+	idle_workers,
+	queued_tasks,
+	pool_shutdown;
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  pool_cond = PTHREAD_COND_INITIALIZER;
+pthread_attr_t  worker_attr;
+int     move_budget = DEFAULT_MOVE_BUDGET,
+	search_timeout,
+	search_estimated;
+long    search_nodes;
+struct timespec search_deadline;
+int     deadline_given;
+long    mcts_iterations;
+mcts_t *mcts_threads;
+int     mcts_count;
+uint64_t mcts_delta[NUM_CHILDREN];
+int     tournament_games,
+	next_game,
+	*script,
+	script_length;
+agent_t opponent = OPTIMAL_AGENT;
+int     sweep_mode;
+pile_t  sweep_lo[4],
+	sweep_hi[4],
+	sweep_kmin,
+	sweep_kmax;
+sweep_pile_t *sweep_piles;
+signed char *sweep_results;
+long    sweep_size,
+	sweep_next;
+unsigned int base_seed = 1;
 
 
 int main(int argc, char **argv)
 {
-	if (argc != 5)
-		ERROR_EXIT("USAGE: %s M K1 K2 K3\n", argv[0]);
-
 	atexit(&free_memory);
 
-	get_args(argv);
-	root = build_game_tree();
-	play_game();
+	get_args(argc, argv);
+	if (check_mode)
+		return check_grundy() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if (bench_mode)
+	{
+		run_bench();
+		return EXIT_SUCCESS;
+	}
+
+	if (sweep_mode)
+	{
+		run_sweep();
+		return EXIT_SUCCESS;
+	}
+
+	prepare_engine();
+	if (variant_spec)
+		play_variant();
+	else if (tournament_games)
+		run_tournament();
+	else
+		play_game();
 
 	return EXIT_SUCCESS;
 }
 
 
-void get_args(char **argv)
+/* Allocates or computes whatever the selected engine needs */
+void prepare_engine(void)
+{
+	switch (engine)
+	{
+		case MINIMAX:
+		case ALPHA_BETA:
+			alloc_search_stack(3*M+1);
+			break;
+		case TRANSPOSITION:
+			alloc_search_stack(3*M+1);
+			alloc_transposition_table();
+			break;
+		case RETROGRADE:
+			alloc_search_stack(3*M+1);
+			if (!table_path || !load_outcome_table(table_path))
+			{
+				alloc_transposition_table();
+				retrograde_analysis();
+				if (table_path)
+					save_outcome_table(table_path);
+			}
+			break;
+		case GRUNDY:
+			compute_grundy_values();
+			break;
+		case PARALLEL:
+			start_workers();
+			break;
+		case MCTS:
+			alloc_mcts();
+			break;
+		default:
+			break;
+	}
+}
+
+
+void get_args(int argc, char **argv)
 {
-	M = atoi(argv[1]);
+	int opt, i, engine_given = 0;
+
+	while ((opt = getopt(argc, argv, "e:f:cj:t:i:p:g:o:s:bv:w")) != -1)
+	{
+		switch (opt)
+		{
+			case 'e':
+				for (i = 0; i < NUM_ENGINES &&
+						strcmp(optarg, engine_names[i]); i++)
+					;
+				if (i == NUM_ENGINES)
+					ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+				engine = (engine_t) i;
+				engine_given = 1;
+				break;
+			case 'j':
+				if ((num_workers = atoi(optarg)) <= 0)
+					ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+				break;
+			case 't':
+				if ((move_budget = atoi(optarg)) <= 0)
+					ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+				deadline_given = 1;
+				break;
+			case 'i':
+				if ((mcts_iterations = atol(optarg)) <= 0)
+					ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+				break;
+			case 'p':
+				if (strcmp(optarg, "optimal") == 0)
+					min_optimal = 1;
+				else if (strcmp(optarg, "nonoptimal") == 0)
+					min_optimal = 0;
+				else
+					ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+				break;
+			case 'g':
+				if ((tournament_games = atoi(optarg)) <= 0)
+					ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+				break;
+			case 'o':
+				if (strcmp(optarg, "optimal") == 0)
+					opponent = OPTIMAL_AGENT;
+				else if (strcmp(optarg, "greedy") == 0)
+					opponent = GREEDY_AGENT;
+				else if (strcmp(optarg, "random") == 0)
+					opponent = RANDOM_AGENT;
+				else if (strncmp(optarg, "script:", 7) == 0)
+				{
+					opponent = SCRIPT_AGENT;
+					load_script(optarg + 7);
+				}
+				else
+					ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+				break;
+			case 's':
+				base_seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'f':
+				table_path = optarg;
+				break;
+			case 'c':
+				check_mode = 1;
+				break;
+			case 'b':
+				bench_mode = 1;
+				break;
+			case 'v':
+				variant_spec = optarg;
+				break;
+			case 'w':
+				sweep_mode = 1;
+				break;
+			default:
+				ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+		}
+	}
+
+	/* A variant is played interactively, by the Grundy engine */
+	if (variant_spec)
+	{
+		if (engine_given && engine != GRUNDY)
+			ERROR_EXIT("-v: variants are only played by grundy\n");
+		if (check_mode || bench_mode || tournament_games ||
+				num_workers || sweep_mode)
+			ERROR_EXIT("-v: cannot be combined with -c, -b, -g, -j "
+					"or -w\n");
+		if (argc - optind != 1)
+			ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+		engine = GRUNDY;
+		M = parse_pile(argv[optind]);
+		if (M < 1)
+			ERROR_EXIT("M: should be equal to 1 or more\n");
+		parse_variant(variant_spec);
+		build_move_table();
+		return;
+	}
+
+	/* A sweep solves every configuration of the ranges with Grundy values */
+	if (sweep_mode)
+	{
+		if (argc - optind != 4 || check_mode || bench_mode ||
+				tournament_games || (engine_given &&
+				engine != GRUNDY))
+			ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+		if (!min_optimal)
+			ERROR_EXIT("-w: requires a MIN that plays optimally\n");
+		for (i = 0; i < 4; i++)
+			parse_range(argv[optind + i], &sweep_lo[i], &sweep_hi[i]);
+		if (sweep_lo[0] < 3)
+			ERROR_EXIT("M: should be equal to 3 or more\n");
+		for (i = 1; i < 4; i++)
+			if (sweep_lo[i] < 2)
+				ERROR_EXIT("K%d: should be equal to 2 or more\n", i);
+		/* Only the move numbers are used, the K vary */
+		K1 = sweep_lo[1];
+		K2 = sweep_lo[2];
+		K3 = sweep_lo[3];
+		build_classic_moves();
+		return;
+	}
+
+	if (argc - optind != 4)
+		ERROR_EXIT(USAGE, argv[0], argv[0], argv[0]);
+	if (!engine_given)
+		engine = DEFAULT_ENGINE;
+	/* Any other engine or mode would silently run on one thread */
+	if (num_workers && engine != PARALLEL && engine != MCTS &&
+			!(tournament_games && ENGINE_IS_REENTRANT(engine)))
+		ERROR_EXIT("-j: only the parallel and mcts engines, and "
+				"tournaments with grundy or retro, use threads\n");
+	argv += optind - 1;
+
+	M = parse_pile(argv[1]);
 	if (M < 3)
 		ERROR_EXIT("M: should be equal to 3 or more\n");
+	if (M > MAX_SEARCH_M && (engine != GRUNDY || check_mode))
+		ERROR_EXIT("M: should be at most %d unless using grundy\n",
+				MAX_SEARCH_M);
+	if (M > MAX_TREE_M && (ENGINE_USES_TREE(engine) || check_mode))
+		ERROR_EXIT("M: should be at most %d when using a game tree\n",
+				MAX_TREE_M);
+	if (M > MAX_PARALLEL_M && engine == PARALLEL)
+		ERROR_EXIT("M: should be at most %d when using parallel\n",
+				MAX_PARALLEL_M);
+	if (M > MAX_MCTS_M && engine == MCTS)
+		ERROR_EXIT("M: should be at most %d when using mcts\n",
+				MAX_MCTS_M);
 
-	K1 = atoi(argv[2]);
+	K1 = parse_pile(argv[2]);
 	if (K1 <=1 || K1 >= M)
-		ERROR_EXIT("K1: should be in interval [2,%d]\n", M-1);
+		ERROR_EXIT("K1: should be in interval [2,%lld]\n", M-1);
 
-	K2 = atoi(argv[3]);
+	K2 = parse_pile(argv[3]);
 	if (K2 <=1 || K2 >= M)
-		ERROR_EXIT("K2: should be in interval [2,%d]\n", M-1);
+		ERROR_EXIT("K2: should be in interval [2,%lld]\n", M-1);
 
-	K3 = atoi(argv[4]);
+	K3 = parse_pile(argv[4]);
 	if (K3 <=1 || K3 >= M)
-		ERROR_EXIT("K3: should be in interval [2,%d]\n", M-1);
+		ERROR_EXIT("K3: should be in interval [2,%lld]\n", M-1);
+	build_classic_moves();
+
+	if (engine != ALPHA_BETA)
+		return;
+	killer = (int *) malloc((3*M+1) * sizeof(int));
+	if (!killer)
+	{
+		perror("malloc");
+		exit(errno);
+	}
+	memset(killer, -1, (3*M+1) * sizeof(int));
 }
 
 
-node_t *build_game_tree(void)
+/*
+ * Starts a new game tree holding only node. The rest of the tree is
+ * expanded one level at a time, when a search or the game reaches a node.
+ */
+uint32_t build_game_tree(node_t *node)
 {
-	node_t *root = alloc_tree_node(NULL);
-	build_next_level(root);
-	return root;
+	tree_size = 0;
+	alloc_tree_nodes(1);
+	tree[0].state = PACK_STATE(node);
+	tree[0].expanded = 0;
+	tree[0].value = TREE_NO_VALUE;
+	tree[0].moves = 0;
+	return 0;
 }
 
 
-void build_next_level(node_t *node)
+void build_next_level(uint32_t index)
 {
-	int i;
+	node_t   node, child;
+	uint32_t first;
+	int      i, n = 0, moves = 0;
 
-	if (!node)
+	if (tree[index].expanded)
 		return;
 
+	unpack_state(tree[index].state, &node);
 	for (i = 0; i < NUM_CHILDREN; i++)
+		if (legal_move(&node, i))
+			moves |= 1 << i, n++;
+		else
+			STAT_ADD(illegal_moves, 1);
+	/* May move tree[], so index is used rather than a pointer */
+	first = alloc_tree_nodes(n);
+	for (i = 0, n = 0; i < NUM_CHILDREN; i++)
 	{
-		node->children[i] = create_state(node, i);
-		if (!IS_FINAL_STATE(node))
-			build_next_level(node->children[i]);
+		if (!(moves & (1 << i)))
+			continue;
+		child = node;
+		apply_move(&child, i);
+		child.depth++;
+		tree[first + n].state = PACK_STATE(&child);
+		tree[first + n].expanded = 0;
+		tree[first + n].value = TREE_NO_VALUE;
+		tree[first + n].moves = 0;
+		n++;
 	}
+	tree[index].children = first;
+	tree[index].moves = moves;
+	tree[index].expanded = 1;
 }
 
 
-node_t *alloc_tree_node(node_t *parent)
+/* Appends count nodes to tree[], returning the index of the first one */
+uint32_t alloc_tree_nodes(int count)
 {
-	node_t *node = (node_t *) malloc(sizeof(node_t));
+	void *tmp;
 
-	if (!node)
+	if (tree_size + count > tree_capacity)
 	{
-		perror("malloc");
-		exit(errno);
+		if (tree_capacity > UINT32_MAX / 2)
+			ERROR_EXIT("tree: too many nodes\n");
+		tree_capacity = (tree_capacity) ? 2 * tree_capacity : 4096;
+		tmp = realloc(tree, tree_capacity * sizeof(tree_node_t));
+		if (!tmp)
+		{
+			perror("realloc");
+			exit(errno);
+		}
+		tree = (tree_node_t *) tmp;
 	}
+	tree_size += count;
+	STAT_ADD(nodes_created, count);
+	return tree_size - count;
+}
+
+
+void unpack_state(uint64_t state, node_t *node)
+{
+	node->r = state & FIELD_MASK;
+	node->g = (state >> FIELD_BITS) & FIELD_MASK;
+	node->y = (state >> 2*FIELD_BITS) & FIELD_MASK;
+	node->depth = (state >> 3*FIELD_BITS) & FIELD_MASK;
+}
+
+
+int legal_move(node_t *node, int caseno)
+{
+	return (caseno >= 0 && caseno < NUM_CHILDREN &&
+			NODE_PILE(node, move_pile[caseno]) >= move_amount[caseno]);
+}
 
-	if (!parent)
-	{
-		node->r = node->g = node->y = M;
-		node->depth = 0;
-		node->parent = NULL;
-	}
-	else
-	{
-		*node = *parent;
-		++(node->depth);
-		node->parent = parent;
-	}
 
-	return node;
+/*
+ * Removes the tokens of move caseno from node, in place. Returns 0 and
+ * leaves node unchanged if the move is illegal.
+ */
+int apply_move(node_t *node, int caseno)
+{
+	if (!legal_move(node, caseno))
+		return 0;
+	NODE_PILE(node, move_pile[caseno]) -= move_amount[caseno];
+	return 1;
 }
 
 
-node_t *create_state(node_t *parent, int caseno)
+/*
+ * Makes the child of index for move caseno the root of the tree. Its
+ * subtree is copied breadth-first into the spare array, which then
+ * becomes tree[]: every other node can no longer be reached, and the
+ * copy keeps the children of each node next to each other.
+ */
+uint32_t advance(uint32_t index, int caseno)
 {
-	int     can_update = 1;
-	node_t *node = alloc_tree_node(parent);
+	tree_node_t *tmp;
+	uint32_t     scan, size = 1, count, capacity;
 
-	switch (caseno)
+	build_next_level(index);
+	if (spare_capacity < tree_size)
 	{
-		case 0:
-			if (CAN_REMOVE_RED(node, 1))
-				--(node->r);
-			else
-				can_update = 0;
-			break;
-		case 1:
-			if (CAN_REMOVE_GRN(node, 1))
-				--(node->g);
-			else
-				can_update = 0;
-			break;
-		case 2:
-			if (CAN_REMOVE_YLO(node, 1))
-				--(node->y);
-			else
-				can_update = 0;
-			break;
-		case 3:
-			if (CAN_REMOVE_RED(node, K1))
-				node->r -= K1;
-			else
-				can_update = 0;
-			break;
-		case 4:
-			if (CAN_REMOVE_GRN(node, K2))
-				node->g -= K2;
-			else
-				can_update = 0;
-			break;
-		case 5:
-			if (CAN_REMOVE_YLO(node, K3))
-				node->y -= K3;
-			else
-				can_update = 0;
-			break;
+		free(spare_tree);
+		spare_capacity = tree_capacity;
+		spare_tree = (tree_node_t *) malloc(spare_capacity *
+				sizeof(tree_node_t));
+		if (!spare_tree)
+		{
+			perror("malloc");
+			exit(errno);
+		}
 	}
-
-	if (!can_update)
+	spare_tree[0] = tree[CHILD_INDEX(&tree[index], caseno)];
+	for (scan = 0; scan < size; scan++)
 	{
-		free(node);
-		return NULL;
+		if (!spare_tree[scan].expanded)
+			continue;
+		count = __builtin_popcount(spare_tree[scan].moves);
+		memcpy(spare_tree + size, tree + spare_tree[scan].children,
+				count * sizeof(tree_node_t));
+		spare_tree[scan].children = size;
+		size += count;
 	}
 
-	return node;
+	tmp = tree;
+	tree = spare_tree;
+	spare_tree = tmp;
+	capacity = tree_capacity;
+	tree_capacity = spare_capacity;
+	spare_capacity = capacity;
+	tree_size = size;
+	return 0;
 }
 
 
+/*
+ * The game is played on a position; the tree engines additionally keep
+ * the tree rooted at it, through advance().
+ */
 void play_game(void)
 {
-	node_t *currnode = root;
-	int i = 0;
+	node_t currnode;
+	int    i = 0, choice;
 
+	currnode.r = currnode.g = currnode.y = M;
+	currnode.depth = 0;
+	if (ENGINE_USES_TREE(engine))
+		root = build_game_tree(&currnode);
 	do
 	{
 		printf("\n############ %s's turn ##############\n",
 				(i++ == 0) ? "MAX" : "MIN");
 		i %= 2;
-		print_board(currnode);
-		print_options(currnode);
-		if (MAXIMIZING_PLAYER(currnode))
+		print_board(&currnode);
+		print_options(&currnode);
+		if (MAXIMIZING_PLAYER(&currnode))
 		{
-			minimax(currnode);
-			currnode = currnode->children[next_max_choice];
+			decide_max_move(&currnode);
+			choice = next_max_choice;
+#ifdef SEARCH_STATS
+			print_search_stats();
+#endif
 		}
 		else
-			currnode = currnode->children[read_option()];
+			choice = read_option();
+		if (ENGINE_USES_TREE(engine))
+			root = advance(root, choice);
+		apply_move(&currnode, choice);
+		currnode.depth++;
 	}
-	while (!IS_FINAL_STATE(currnode));
+	while (!IS_FINAL_STATE(&currnode));
 	printf("\n################################\n");
 	printf("#    Winner is %s!!!          #\n", (i == 1) ? "MAX" : "MIN");
 	printf("################################\n");
 }
 
 
-void print_board(node_t *node)
+/* Returns the value of a pile size argument, or -1 if it is not valid */
+pile_t parse_pile(char *arg)
 {
-	int i;
+	char  *end;
+	pile_t n;
+
+	errno = 0;
+	n = strtoll(arg, &end, 10);
+	if (errno || end == arg || *end != '\0')
+		return -1;
+	return n;
+}
+
 
+void print_board(node_t *node)
+{
 	printf("Current board state:\n\t");
-	for (i = 0; i < node->r; i++)
-		printf("\x1B[31m[] ");
+	print_pile(node->r, "\x1B[31m");
 	printf("\n\t");
-	for (i = 0; i < node->g; i++)
-		printf("\x1B[32m[] ");
+	print_pile(node->g, "\x1B[32m");
 	printf("\n\t");
-	for (i = 0; i < node->y; i++)
-		printf("\x1B[33m[] ");
+	print_pile(node->y, "\x1B[33m");
 	printf("\n");
 	printf("\x1B[0m");
 }
 
 
+/* Piles too large to draw are printed as a token count */
+void print_pile(pile_t n, char *color)
+{
+	pile_t i;
+
+	if (n > MAX_BOARD_TOKENS)
+	{
+		printf("%s[] x %lld", color, n);
+		return;
+	}
+	for (i = 0; i < n; i++)
+		printf("%s[] ", color);
+}
+
+
 void print_options(node_t *node)
 {
 	int i;
@@ -266,162 +998,2103 @@ void print_options(node_t *node)
 	printf("Available options:\n");
 	for (i = 0; i < NUM_CHILDREN; i++)
 	{
-		options[i] = 0;
-		switch (i)
-		{
-			case 0:
-				if (CAN_REMOVE_RED(node, 1))
-				{
-					options[i] = 1;
-					PRINT_MENU_OPTION(i, 1, "RED");
-				}
-				break;
-			case 1:
-				if (CAN_REMOVE_GRN(node, 1))
-				{
-					options[i] = 1;
-					PRINT_MENU_OPTION(i, 1, "GREEN");
-				}
-				break;
-			case 2:
-				if (CAN_REMOVE_YLO(node, 1))
-				{
-					options[i] = 1;
-					PRINT_MENU_OPTION(i, 1, "YELLOW");
-				}
-				break;
-			case 3:
-				if (CAN_REMOVE_RED(node, K1))
-				{
-					options[i] = 1;
-					PRINT_MENU_OPTION(i, K1, "RED");
-				}
-				break;
-			case 4:
-				if (CAN_REMOVE_GRN(node, K2))
-				{
-					options[i] = 1;
-					PRINT_MENU_OPTION(i, K2, "GREEN");
-				}
-				break;
-			case 5:
-				if (CAN_REMOVE_YLO(node, K3))
-				{
-					options[i] = 1;
-					PRINT_MENU_OPTION(i, K3, "YELLOW");
-				}
-				break;
-		}
+		options[i] = legal_move(node, i);
+		if (options[i])
+			PRINT_MENU_OPTION(i, move_amount[i],
+					pile_names[move_pile[i]]);
 	}
 }
 
 
-int minimax(node_t *node)
-{
-	int bestvalue, i, tmp_value;
+/*
+ * minimax(), alphabeta(), tt_search(), parallel_search(), split_search()
+ * and deepening_search(), once per MIN policy. Callers pick the variant
+ * through POLICY_CALL().
+ */
+#define MIN_OPTIMAL                1
+#define POLICY_SUFFIX              optimal
+#include "search.h"
+#undef  MIN_OPTIMAL
+#undef  POLICY_SUFFIX
+#define MIN_OPTIMAL                0
+#define POLICY_SUFFIX              nonoptimal
+#include "search.h"
+#undef  MIN_OPTIMAL
+#undef  POLICY_SUFFIX
 
-	if (IS_FINAL_STATE(node))
-		return STATE_COST(node);
 
-	if (MAXIMIZING_PLAYER(node))
-	{
-		bestvalue = INT_MIN;
-		for (i = 0; i < NUM_CHILDREN; i++)
-		{
-			if (!node->children[i])
-				continue;
-			tmp_value = minimax(node->children[i]);
-			bestvalue = MAX(bestvalue, tmp_value);
-			if (bestvalue == tmp_value)
-				next_max_choice = i;
-		}
-		return bestvalue;
-	}
-	else
+/*
+ * Reads the removal sets of a variant, one per pile separated by '/',
+ * each a comma separated list of token counts, e.g. "1,2/1,3/1,2,5".
+ * Every pile starts with M tokens.
+ */
+void parse_variant(char *spec)
+{
+	char  *set, *amount, *end;
+	pile_t n;
+	int    i, j;
+
+	num_piles = 0;
+	for (set = strtok(spec, "/"); set; set = strtok(NULL, "/"))
 	{
-#ifdef MIN_PLAYS_OPTIMALLY
-		bestvalue = INT_MAX;
-#else
-		bestvalue = 0;
-#endif
-		for (i = 0; i < NUM_CHILDREN; i++)
+		if (num_piles == MAX_PILES)
+			ERROR_EXIT("-v: at most %d piles\n", MAX_PILES);
+		for (amount = set; *amount; amount = end)
 		{
-			if (!node->children[i])
+			errno = 0;
+			n = strtoll(amount, &end, 10);
+			if (errno || end == amount || (*end && *end++ != ',') ||
+					n < 1 || n > M)
+				ERROR_EXIT("-v: removals should be in interval "
+						"[1,%lld]\n", M);
+			j = removal_count[num_piles];
+			for (i = 0; i < j && removals[num_piles][i] != n; i++)
+				;
+			if (i < j)
 				continue;
-			tmp_value = minimax(node->children[i]);
-#ifdef MIN_PLAYS_OPTIMALLY
-			bestvalue = MIN(bestvalue, tmp_value);
-#else
-			bestvalue = MAX(bestvalue, tmp_value);
-#endif
+			if (j == MAX_REMOVALS)
+				ERROR_EXIT("-v: at most %d removals per pile\n",
+						MAX_REMOVALS);
+			/* Kept sorted, so that move ranks follow the amounts */
+			for (i = j; i > 0 && removals[num_piles][i-1] > n; i--)
+				removals[num_piles][i] = removals[num_piles][i-1];
+			removals[num_piles][i] = n;
+			removal_count[num_piles]++;
 		}
-		return bestvalue;
+		if (removal_count[num_piles] == 0)
+			ERROR_EXIT("-v: empty removal set\n");
+		num_piles++;
 	}
+	if (num_piles == 0)
+		ERROR_EXIT("-v: no piles\n");
 }
 
 
-int calculate_state_cost(node_t *node)
+/*
+ * Numbers the moves of the piles rank by rank: the smallest removal of
+ * every pile first, then the second smallest and so on, which gives the
+ * three-pile game its usual move numbers. pile_class[] maps each pile to the first pile with the same removal
+ * set, whose moves are interchangeable with its own.
+ */
+void build_move_table(void)
 {
-	if (IS_FINAL_STATE(node))
+	int p, q, rank, longest = 0;
+
+	symmetric_piles = 0;
+	for (p = 0; p < num_piles; p++)
 	{
-		if (MAXIMIZING_PLAYER(node->parent))
-#if 1
-			return (MAX_WINNING_VALUE - node->depth);
-#else
-			return (MAX_WINNING_VALUE);
-#endif
-		else
-#if 1
-			return (MIN_WINNING_VALUE + node->depth);
-#else
-			return (MIN_WINNING_VALUE);
-#endif
+		longest = MAX(longest, removal_count[p]);
+		for (q = 0; removal_count[q] != removal_count[p] ||
+				memcmp(removals[q], removals[p],
+					removal_count[p] * sizeof(pile_t)); q++)
+			;
+		pile_class[p] = q;
+		symmetric_piles |= (q != p);
 	}
-	else
-		ERROR_EXIT("state cost values can only be assigned to terminal nodes");
+	num_moves = 0;
+	for (rank = 0; rank < longest; rank++)
+		for (p = 0; p < num_piles; p++)
+			if (rank < removal_count[p])
+			{
+				pile_move[p][rank] = num_moves;
+				move_pile[num_moves] = p;
+				move_rank[num_moves] = rank;
+				move_amount[num_moves++] = removals[p][rank];
+			}
 }
 
 
-int read_option(void)
+/*
+ * The three-pile game, as a variant: moves 0-2 remove a token of each
+ * pile, moves 3-5 K1, K2 and K3 tokens.
+ */
+void build_classic_moves(void)
 {
-	int choice, i;
+	pile_t k[3] = {K1, K2, K3};
+	int    p;
 
-	do
+	num_piles = 3;
+	for (p = 0; p < 3; p++)
 	{
-		printf("Enter choice: ");
-		if (scanf("%d", &choice) != 1)
-		{
-			ERROR("scanf: Error reading choice\n");
-		        continue;
-		}
-		if (choice >= 0 && choice < NUM_CHILDREN && VALID_OPTION(choice))
-			break;
-		ERROR("Valid options: ");
-		for (i = 0; i < NUM_CHILDREN; i++)
-			if (options[i])
-				ERROR("%d ", i);
-		ERROR("\n");
+		removals[p][0] = 1;
+		removals[p][1] = k[p];
+		removal_count[p] = 2;
 	}
-	while (1);
-	return choice;
+	build_move_table();
 }
 
 
-void free_memory(void)
+int variant_nim_sum(pile_t *piles)
 {
-	free_game_tree(root);
+	int p, sum = 0;
+
+	for (p = 0; p < num_piles; p++)
+		sum ^= GRUNDY_VALUE(grundy[p], piles[p]);
+	return sum;
 }
 
 
-void free_game_tree(node_t *node)
+/*
+ * Same choice as grundy_move(): the highest move to a zero nim-sum, or
+ * else the first legal move, which removes the fewest tokens of its
+ * pile. A move only changes one pile, and so one term of the nim-sum.
+ */
+int variant_move(pile_t *piles)
 {
-	int i, cnum;
-
-	if (!node)
-		return;
+	int i, p, sum = variant_nim_sum(piles);
 
-	for (i = cnum = 0; i < NUM_CHILDREN; i++)
-		free_game_tree(node->children[i]);
-	free(node);
+	for (i = num_moves-1; i >= 0; i--)
+	{
+		p = move_pile[i];
+		if (piles[p] >= move_amount[i] &&
+				(sum ^ GRUNDY_VALUE(grundy[p], piles[p]) ^
+				 GRUNDY_VALUE(grundy[p], piles[p] - move_amount[i])) == 0)
+			return i;
+	}
+	for (i = 0; i < num_moves; i++)
+		if (piles[move_pile[i]] >= move_amount[i])
+			return i;
+	return -1;
 }
 
+
+/*
+ * play_game() for a variant, with MAX playing the moves of the Grundy
+ * engine. As a pile may keep tokens that none of its moves can remove,
+ * the game ends once no move is possible, and the last mover wins.
+ */
+void play_variant(void)
+{
+	pile_t piles[MAX_PILES];
+	int    i, p, turn = 0, choice;
+
+	for (p = 0; p < num_piles; p++)
+		piles[p] = M;
+	while (1)
+	{
+		for (i = 0; i < num_moves &&
+				piles[move_pile[i]] < move_amount[i]; i++)
+			;
+		if (i == num_moves)
+			break;
+		printf("\n############ %s's turn ##############\n",
+				(turn == 0) ? "MAX" : "MIN");
+		print_variant(piles);
+		if (turn == 0)
+			choice = variant_move(piles);
+		else
+			choice = read_option();
+		piles[move_pile[choice]] -= move_amount[choice];
+		turn = !turn;
+	}
+	printf("\n################################\n");
+	printf("#    Winner is %s!!!          #\n", (turn == 1) ? "MAX" : "MIN");
+	printf("################################\n");
+}
+
+
+/* print_board() and print_options() for a variant */
+void print_variant(pile_t *piles)
+{
+	int i, p;
+
+	printf("Current board state:\n");
+	for (p = 0; p < num_piles; p++)
+	{
+		printf("\t");
+		print_pile(piles[p], pile_colors[p]);
+		printf("\n");
+	}
+	printf("\x1B[0m");
+	printf("Available options:\n");
+	for (i = 0; i < num_moves; i++)
+	{
+		options[i] = (piles[move_pile[i]] >= move_amount[i]);
+		if (options[i])
+			PRINT_MENU_OPTION(i, move_amount[i],
+					pile_names[move_pile[i]]);
+	}
+}
+
+
+/*
+ * Sets next_max_choice to the child of node with the highest minimax
+ * value. Among equally valued children the one with the highest index
+ * is chosen, regardless of the engine used.
+ */
+void decide_max_move(node_t *node)
+{
+	int    i, tmp_value, bestvalue = INT_MIN, searched = 0,
+	       values[NUM_CHILDREN];
+	node_t child;
+
+	if (engine == GRUNDY)
+	{
+		grundy_move(node);
+		return;
+	}
+
+	if (engine == PARALLEL)
+	{
+		parallel_root(node);
+		return;
+	}
+
+	if (engine == DEEPENING)
+	{
+		deepening_move(node);
+		return;
+	}
+
+	if (engine == MCTS)
+	{
+		mcts_move(node);
+		return;
+	}
+
+	if (engine == TRANSPOSITION || engine == RETROGRADE)
+	{
+		for (i = 0; i < NUM_CHILDREN; i++)
+		{
+			child = *node;
+			if (!apply_move(&child, i))
+				continue;
+			child.depth++;
+			tmp_value = POLICY_CALL(tt_search, &child);
+			if (tmp_value >= bestvalue)
+			{
+				bestvalue = tmp_value;
+				next_max_choice = i;
+			}
+		}
+		return;
+	}
+
+	/* The tree engines search the tree that play_game() keeps at node */
+	build_next_level(root);
+	if (engine == MINIMAX)
+	{
+		for (i = 0; i < NUM_CHILDREN; i++)
+		{
+			if (!HAS_MOVE(&tree[root], i))
+				continue;
+			if (mirror_move(node, i) != i)
+				tmp_value = values[mirror_move(node, i)];
+			else
+				tmp_value = POLICY_CALL(minimax,
+						CHILD_INDEX(&tree[root], i));
+			values[i] = tmp_value;
+			if (tmp_value >= bestvalue)
+			{
+				bestvalue = tmp_value;
+				next_max_choice = i;
+			}
+		}
+		return;
+	}
+
+	/*
+	 * Searching the children from the highest index down with a window
+	 * that excludes the current best value resolves ties exactly as
+	 * above, while every child that cannot improve fails low quickly.
+	 * Of the children that mirror each other only the highest one is
+	 * searched, as the others cannot improve on it.
+	 */
+	for (i = NUM_CHILDREN-1; i >= 0; i--)
+	{
+		if (!HAS_MOVE(&tree[root], i) ||
+				(searched & (1 << mirror_move(node, i))))
+			continue;
+		searched |= 1 << mirror_move(node, i);
+		tmp_value = POLICY_CALL(alphabeta, CHILD_INDEX(&tree[root], i),
+				bestvalue, INT_MAX);
+		if (tmp_value > bestvalue)
+		{
+			bestvalue = tmp_value;
+			next_max_choice = i;
+		}
+	}
+}
+
+
+/*
+ * Fills order with the indices of the existing children of node, in the
+ * order they should be searched, terminated by -1 if fewer than
+ * NUM_CHILDREN: moves that end the game first, then the killer move of
+ * this depth, then big removals before single-token ones. Children that
+ * mirror an earlier sibling (see mirror_move()) are left out.
+ */
+void order_moves(uint32_t index, int *order)
+{
+	static const int static_order[NUM_CHILDREN] = {3, 4, 5, 0, 1, 2};
+	tree_node_t *node = &tree[index];
+	node_t       position;
+	int          i, k, n = 0, taken[NUM_CHILDREN] = {0};
+
+	unpack_state(node->state, &position);
+	for (i = 0; i < NUM_CHILDREN; i++)
+		if (!HAS_MOVE(node, i) || mirror_move(&position, i) != i)
+			taken[i] = 1;
+		else if (FINAL_STATE(tree[CHILD_INDEX(node, i)].state))
+			order[n++] = i, taken[i] = 1;
+	i = killer[TREE_DEPTH(node)];
+	if (i != -1 && !taken[i])
+		order[n++] = i, taken[i] = 1;
+	for (k = 0; k < NUM_CHILDREN; k++)
+		if (!taken[i = static_order[k]])
+			order[n++] = i;
+	if (n < NUM_CHILDREN)
+		order[n] = -1;
+}
+
+
+/*
+ * Piles with equal K are interchangeable: permuting them does not change
+ * the value of a position. Returns the lowest move of node that leads to
+ * a permutation of the position move caseno leads to, which is caseno
+ * unless an earlier pile has the same K and as many tokens.
+ */
+int mirror_move(node_t *node, int caseno)
+{
+	int p = move_pile[caseno], q;
+
+	if (!symmetric_piles)
+		return caseno;
+	for (q = pile_class[p]; q < p; q++)
+		if (pile_class[q] == pile_class[p] &&
+				NODE_PILE(node, q) == NODE_PILE(node, p))
+			return pile_move[q][move_rank[caseno]];
+	return caseno;
+}
+
+
+/* Sorts the piles of node that have equal K, so that permutations match */
+void canonical_position(node_t *node)
+{
+	if (pile_class[1] == pile_class[0])
+		SORT_PILES(node->r, node->g);
+	if (pile_class[2] == pile_class[0])
+		SORT_PILES(node->r, node->y);
+	if (pile_class[2] == pile_class[1])
+		SORT_PILES(node->g, node->y);
+}
+
+
+/*
+ * Grows the stack of minimax(), alphabeta(), tt_search() and
+ * deepening_search() to at least 'frames' frames. A game lasts at most
+ * 3*M moves, so 3*M+1 frames hold any path from a root to a terminal.
+ */
+void alloc_search_stack(int frames)
+{
+	void *tmp;
+
+	if (frames <= search_stack_size)
+		return;
+	tmp = realloc(search_stack, frames * sizeof(search_frame_t));
+	if (!tmp)
+	{
+		perror("realloc");
+		exit(errno);
+	}
+	search_stack = (search_frame_t *) tmp;
+	search_stack_size = frames;
+}
+
+
+/*
+ * Same ordering as order_moves() for a position that has not been
+ * expanded. The killer move is left out, as workers would race on it.
+ */
+void order_positions(node_t *node, int *order)
+{
+	static const int static_order[NUM_CHILDREN] = {3, 4, 5, 0, 1, 2};
+	int    i, k, n = 0, taken[NUM_CHILDREN] = {0};
+	node_t child;
+
+	for (i = 0; i < NUM_CHILDREN; i++)
+	{
+		child = *node;
+		if (!apply_move(&child, i) || mirror_move(node, i) != i)
+			taken[i] = 1;
+		else if (IS_FINAL_STATE(&child))
+			order[n++] = i, taken[i] = 1;
+	}
+	for (k = 0; k < NUM_CHILDREN; k++)
+		if (!taken[i = static_order[k]])
+			order[n++] = i;
+	if (n < NUM_CHILDREN)
+		order[n] = -1;
+}
+
+
+/*
+ * The parallel engine runs alphabeta() over positions on a pool of
+ * workers (the main thread being worker 0). The root moves are split
+ * among the workers; deeper, a node is split Young Brothers Wait style,
+ * i.e. only after its first move has been searched, and only while some
+ * worker is idle. Idle workers steal tasks from the head of the other
+ * deques, and a cutoff found by any task aborts its siblings. Every
+ * worker, including the thread that runs the root split for the main
+ * thread, has a stack of PARALLEL_STACK_SIZE, whatever `ulimit -s` is.
+ */
+void start_workers(void)
+{
+	int i;
+
+	pthread_attr_init(&worker_attr);
+	if ((errno = pthread_attr_setstacksize(&worker_attr,
+			PARALLEL_STACK_SIZE)))
+	{
+		perror("pthread_attr_setstacksize");
+		exit(errno);
+	}
+
+	if (num_workers <= 0)
+		num_workers = MAX(1, (int) sysconf(_SC_NPROCESSORS_ONLN));
+	workers = (worker_t *) calloc(num_workers, sizeof(worker_t));
+	if (!workers)
+	{
+		perror("calloc");
+		exit(errno);
+	}
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].id = i;
+		pthread_mutex_init(&workers[i].lock, NULL);
+	}
+	for (i = 1; i < num_workers; i++)
+		if ((errno = pthread_create(&workers[i].thread, &worker_attr,
+				worker_loop, &workers[i])))
+		{
+			perror("pthread_create");
+			exit(errno);
+		}
+}
+
+
+void stop_workers(void)
+{
+	int i;
+
+	if (!workers)
+		return;
+	pthread_mutex_lock(&pool_lock);
+	pool_shutdown = 1;
+	pthread_cond_broadcast(&pool_cond);
+	pthread_mutex_unlock(&pool_lock);
+	for (i = 1; i < num_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+	for (i = 0; i < num_workers; i++)
+	{
+		pthread_mutex_destroy(&workers[i].lock);
+		free(workers[i].tasks);
+	}
+	free(workers);
+	workers = NULL;
+	pthread_attr_destroy(&worker_attr);
+}
+
+
+void *worker_loop(void *arg)
+{
+	worker_t *worker = (worker_t *) arg;
+	task_t    task;
+
+	for (;;)
+	{
+		if (take_task(worker, NULL, &task))
+		{
+			run_task(worker, &task);
+			continue;
+		}
+		pthread_mutex_lock(&pool_lock);
+		__atomic_add_fetch(&idle_workers, 1, __ATOMIC_RELAXED);
+		while (!queued_tasks && !pool_shutdown)
+			pthread_cond_wait(&pool_cond, &pool_lock);
+		__atomic_sub_fetch(&idle_workers, 1, __ATOMIC_RELAXED);
+		if (pool_shutdown)
+		{
+			pthread_mutex_unlock(&pool_lock);
+			return NULL;
+		}
+		pthread_mutex_unlock(&pool_lock);
+	}
+}
+
+
+void push_task(worker_t *worker, split_t *split, int move)
+{
+	void *tmp;
+
+	pthread_mutex_lock(&worker->lock);
+	if (worker->tail == worker->capacity)
+	{
+		/* Compact before growing, the head only moves forward */
+		memmove(worker->tasks, worker->tasks + worker->head,
+				(worker->tail - worker->head) * sizeof(task_t));
+		worker->tail -= worker->head;
+		worker->head = 0;
+	}
+	if (worker->tail == worker->capacity)
+	{
+		worker->capacity = (worker->capacity) ? 2 * worker->capacity :
+			4 * NUM_CHILDREN;
+		tmp = realloc(worker->tasks, worker->capacity * sizeof(task_t));
+		if (!tmp)
+		{
+			perror("realloc");
+			exit(errno);
+		}
+		worker->tasks = (task_t *) tmp;
+	}
+	worker->tasks[worker->tail].split = split;
+	worker->tasks[worker->tail].move = move;
+	worker->tail++;
+	pthread_mutex_unlock(&worker->lock);
+
+	pthread_mutex_lock(&pool_lock);
+	queued_tasks++;
+	if (idle_workers)
+		pthread_cond_signal(&pool_cond);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+
+/*
+ * Takes a task of 'split' from the tail of the worker's own deque, or
+ * else steals the oldest task of another worker. Without a split, any
+ * task will do. A worker waiting on a split only steals the tasks that
+ * descend from it, which lie deeper in the game, so its stack never
+ * holds more than one parallel_search() frame per ply. Returns 0 if no
+ * task was found.
+ */
+int take_task(worker_t *worker, split_t *split, task_t *task)
+{
+	worker_t *victim;
+	int       i, found = 0;
+
+	pthread_mutex_lock(&worker->lock);
+	if (worker->tail > worker->head && (!split ||
+			worker->tasks[worker->tail - 1].split == split))
+	{
+		*task = worker->tasks[--worker->tail];
+		found = 1;
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	for (i = 1; i < num_workers && !found; i++)
+	{
+		victim = &workers[(worker->id + i) % num_workers];
+		pthread_mutex_lock(&victim->lock);
+		if (victim->tail > victim->head && (!split || split_descends(
+				victim->tasks[victim->head].split, split)))
+		{
+			*task = victim->tasks[victim->head++];
+			found = 1;
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	if (found)
+	{
+		pthread_mutex_lock(&pool_lock);
+		queued_tasks--;
+		pthread_mutex_unlock(&pool_lock);
+	}
+	return found;
+}
+
+
+void run_task(worker_t *worker, task_t *task)
+{
+	split_t *split = task->split;
+	node_t   child = split->node;
+	int      alpha, beta, tmp_value;
+
+	apply_move(&child, task->move);
+	child.depth++;
+
+	pthread_mutex_lock(&split->lock);
+	alpha = split->alpha;
+	beta = split->beta;
+	pthread_mutex_unlock(&split->lock);
+
+	/*
+	 * At the root, a window just below the best value so far is enough
+	 * to tell which moves tie with it, which keeps the choice identical
+	 * to the sequential engines.
+	 */
+	if (split->is_root)
+		alpha = (alpha == INT_MIN) ? INT_MIN : alpha - 1;
+	tmp_value = (ABORTED(split)) ? alpha :
+		split->search(&child, alpha, beta, split, worker);
+
+	pthread_mutex_lock(&split->lock);
+	if (split->is_root)
+		split->values[task->move] = tmp_value;
+	if (!split->cutoff && split->minimizing)
+	{
+		split->bestvalue = MIN(split->bestvalue, tmp_value);
+		split->beta = MIN(split->beta, tmp_value);
+	}
+	else if (!split->cutoff)
+	{
+		split->bestvalue = MAX(split->bestvalue, tmp_value);
+		split->alpha = MAX(split->alpha, tmp_value);
+	}
+	if (split->alpha >= split->beta && !split->cutoff)
+	{
+		STAT_ADD(cutoffs, 1);
+		__atomic_store_n(&split->cutoff, 1, __ATOMIC_RELAXED);
+	}
+	split->pending--;
+	pthread_mutex_unlock(&split->lock);
+}
+
+
+/* Helps with the tasks of the split until all of them have completed */
+void wait_split(worker_t *worker, split_t *split)
+{
+	task_t task;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&split->lock);
+		if (!split->pending)
+		{
+			pthread_mutex_unlock(&split->lock);
+			return;
+		}
+		pthread_mutex_unlock(&split->lock);
+		if (take_task(worker, split, &task))
+			run_task(worker, &task);
+		else
+			sched_yield();
+	}
+}
+
+
+/* Whether split is ancestor or one of the splits below it */
+int split_descends(split_t *split, split_t *ancestor)
+{
+	for (; split; split = split->parent)
+		if (split == ancestor)
+			return 1;
+	return 0;
+}
+
+
+/* A search is aborted as soon as any enclosing split has cut off */
+int split_aborted(split_t *split)
+{
+	for (; split; split = split->parent)
+		if (__atomic_load_n(&split->cutoff, __ATOMIC_RELAXED))
+			return 1;
+	return 0;
+}
+
+
+/*
+ * Runs the root split as worker 0, on a stack of PARALLEL_STACK_SIZE.
+ * next_max_choice is thread-local, so the move comes back through join.
+ */
+void parallel_root(node_t *node)
+{
+	pthread_t thread;
+	void     *choice;
+
+	if ((errno = pthread_create(&thread, &worker_attr, root_loop, node)))
+	{
+		perror("pthread_create");
+		exit(errno);
+	}
+	pthread_join(thread, &choice);
+	next_max_choice = (int) (intptr_t) choice;
+}
+
+
+void *root_loop(void *arg)
+{
+	node_t  *node = (node_t *) arg;
+	split_t  split;
+	int      i, choice = -1, bestvalue = INT_MIN;
+
+	memset(&split, 0, sizeof(split_t));
+	pthread_mutex_init(&split.lock, NULL);
+	split.node = *node;
+	split.alpha = INT_MIN;
+	split.beta = INT_MAX;
+	split.bestvalue = INT_MIN;
+	split.is_root = 1;
+	split.search = (min_optimal) ? parallel_search_optimal :
+		parallel_search_nonoptimal;
+	for (i = 0; i < NUM_CHILDREN; i++)
+	{
+		split.values[i] = INT_MIN;
+		if (legal_move(node, i) && mirror_move(node, i) == i)
+			split.pending++;
+	}
+	for (i = NUM_CHILDREN-1; i >= 0; i--)
+		if (legal_move(node, i) && mirror_move(node, i) == i)
+			push_task(&workers[0], &split, i);
+	wait_split(&workers[0], &split);
+	pthread_mutex_destroy(&split.lock);
+
+	/*
+	 * Moves that failed low are below the best value. Mirrored moves
+	 * were not searched and take the value of the move they mirror.
+	 */
+	for (i = 0; i < NUM_CHILDREN; i++)
+	{
+		split.values[i] = split.values[mirror_move(node, i)];
+		if (legal_move(node, i) && split.values[i] >= bestvalue)
+		{
+			bestvalue = split.values[i];
+			choice = i;
+		}
+	}
+	return (void *) (intptr_t) choice;
+}
+
+
+/*
+ * Iterative deepening under a per-move deadline of 'move_budget' ms:
+ * depth-limited searches of increasing depth, each one replacing the
+ * move of the previous one once it completes. An iteration that runs
+ * past the deadline is discarded. Search stops early when an iteration
+ * did not need evaluate_state(), as its result is then exact.
+ */
+void deepening_move(node_t *node)
+{
+	int    i, limit, tmp_value, bestvalue, choice, searched;
+	node_t child;
+
+	clock_gettime(CLOCK_MONOTONIC, &search_deadline);
+	search_deadline.tv_sec += move_budget / 1000;
+	search_deadline.tv_nsec += (move_budget % 1000) * 1000000L;
+	if (search_deadline.tv_nsec >= 1000000000L)
+	{
+		search_deadline.tv_sec++;
+		search_deadline.tv_nsec -= 1000000000L;
+	}
+	search_timeout = 0;
+	search_nodes = 0;
+
+	next_max_choice = -1;
+	for (i = 0; i < NUM_CHILDREN && next_max_choice == -1; i++)
+		if (legal_move(node, i))
+			next_max_choice = i;
+
+	for (limit = 1; limit <= 3*M; limit++)
+	{
+		/* The root children are searched limit - 1 plies deep */
+		alloc_search_stack(limit);
+		search_estimated = 0;
+		bestvalue = INT_MIN;
+		choice = -1;
+		searched = 0;
+		/* Same order and window as the alphabeta engine at the root */
+		for (i = NUM_CHILDREN-1; i >= 0 && !search_timeout; i--)
+		{
+			child = *node;
+			if (!apply_move(&child, i) ||
+					(searched & (1 << mirror_move(node, i))))
+				continue;
+			searched |= 1 << mirror_move(node, i);
+			child.depth++;
+			tmp_value = POLICY_CALL(deepening_search, &child,
+					bestvalue, INT_MAX, limit - 1);
+			if (!search_timeout && tmp_value > bestvalue)
+			{
+				bestvalue = tmp_value;
+				choice = i;
+			}
+		}
+		if (search_timeout)
+			break;
+		next_max_choice = choice;
+		if (!search_estimated)
+			break;
+	}
+}
+
+
+int past_deadline(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec > search_deadline.tv_sec ||
+			(now.tv_sec == search_deadline.tv_sec &&
+			 now.tv_nsec >= search_deadline.tv_nsec));
+}
+
+
+/*
+ * Monte Carlo tree search: each iteration walks down the tree by UCT,
+ * expands the node it reaches and plays a random game from there on a
+ * packed position, whose outcome is counted on the way back up. The
+ * engine runs -j threads (all cores by default) on trees of their own,
+ * for -i iterations in total or until the -t deadline, and moves to the
+ * child of the root most visited. By default, the iterations are scaled
+ * down from DEFAULT_ITERATIONS so that playouts remove no more than
+ * DEFAULT_PLAYOUT_TOKENS tokens per move, but every move is tried once.
+ */
+void alloc_mcts(void)
+{
+	int i;
+
+	mcts_count = (num_workers > 0) ? num_workers :
+		MAX(1, (int) sysconf(_SC_NPROCESSORS_ONLN));
+	if (!mcts_iterations)
+		mcts_iterations = (deadline_given) ? LONG_MAX :
+			MAX(NUM_CHILDREN, MIN(DEFAULT_ITERATIONS,
+					DEFAULT_PLAYOUT_TOKENS / (3*M)));
+	mcts_threads = (mcts_t *) calloc(mcts_count, sizeof(mcts_t));
+	if (!mcts_threads)
+	{
+		perror("calloc");
+		exit(errno);
+	}
+	for (i = 0; i < mcts_count; i++)
+	{
+		/* A path holds the root and at most 3*M moves */
+		mcts_threads[i].path = (uint32_t *) malloc((3*M+1) *
+				sizeof(uint32_t));
+		if (!mcts_threads[i].path)
+		{
+			perror("malloc");
+			exit(errno);
+		}
+		mcts_threads[i].rng = (base_seed + 1) * 0x9E3779B97F4A7C15ULL +
+			(uint64_t) i * 0xBF58476D1CE4E5B9ULL;
+	}
+	for (i = 0; i < NUM_CHILDREN; i++)
+		mcts_delta[i] = (uint64_t) move_amount[i] << move_pile[i] * MCTS_BITS;
+}
+
+
+void mcts_move(node_t *node)
+{
+	mcts_node_t *child;
+	double       visits[NUM_CHILDREN] = {0}, best = -1;
+	int          i, t, n;
+
+	if (deadline_given)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &search_deadline);
+		search_deadline.tv_sec += move_budget / 1000;
+		search_deadline.tv_nsec += (move_budget % 1000) * 1000000L;
+		if (search_deadline.tv_nsec >= 1000000000L)
+		{
+			search_deadline.tv_sec++;
+			search_deadline.tv_nsec -= 1000000000L;
+		}
+	}
+	for (t = 0; t < mcts_count; t++)
+	{
+		mcts_threads[t].size = 0;
+		mcts_threads[t].depth = node->depth;
+		mcts_threads[t].iterations = mcts_iterations / mcts_count +
+			(t < mcts_iterations % mcts_count);
+		if (mcts_threads[t].capacity == 0)
+		{
+			mcts_threads[t].capacity = 4096;
+			mcts_threads[t].nodes = (mcts_node_t *) malloc(4096 *
+					sizeof(mcts_node_t));
+			if (!mcts_threads[t].nodes)
+			{
+				perror("malloc");
+				exit(errno);
+			}
+		}
+		mcts_threads[t].nodes[0].state = (uint64_t) node->r |
+			(uint64_t) node->g << MCTS_BITS |
+			(uint64_t) node->y << 2*MCTS_BITS;
+		mcts_threads[t].nodes[0].moves =
+			mcts_moves(mcts_threads[t].nodes[0].state);
+		mcts_threads[t].nodes[0].children = 0;
+		mcts_threads[t].nodes[0].visits = 0;
+		mcts_threads[t].nodes[0].wins = 0;
+		mcts_threads[t].size = 1;
+	}
+	for (t = 1; t < mcts_count; t++)
+		if ((errno = pthread_create(&mcts_threads[t].thread, NULL,
+				mcts_worker, &mcts_threads[t])))
+		{
+			perror("pthread_create");
+			exit(errno);
+		}
+	mcts_worker(&mcts_threads[0]);
+	for (t = 1; t < mcts_count; t++)
+		pthread_join(mcts_threads[t].thread, NULL);
+
+	for (t = 0; t < mcts_count; t++)
+	{
+		if (!mcts_threads[t].nodes[0].children)
+			continue;
+		child = &mcts_threads[t].nodes[mcts_threads[t].nodes[0].children];
+		for (i = 0, n = 0; i < NUM_CHILDREN; i++)
+			if ((mcts_threads[t].nodes[0].moves >> i) & 1)
+				visits[i] += child[n++].visits;
+	}
+	/* Ties, and a search that ran out of time at once, go to the highest move */
+	next_max_choice = -1;
+	for (i = 0; i < NUM_CHILDREN; i++)
+		if (legal_move(node, i) && visits[i] >= best)
+		{
+			best = visits[i];
+			next_max_choice = i;
+		}
+}
+
+
+void *mcts_worker(void *arg)
+{
+	mcts_t *search = (mcts_t *) arg;
+	long    i;
+
+	for (i = 0; i < search->iterations; i++)
+		if ((deadline_given && past_deadline()) ||
+				!mcts_iteration(search))
+			break;
+	return NULL;
+}
+
+
+/* Returns 0 if the deadline passed during the playout, which is discarded */
+int mcts_iteration(mcts_t *search)
+{
+	mcts_node_t *node, *child;
+	uint32_t     index = 0, first;
+	double       score, best, log_visits;
+	int          i, n, length = 0, winner;
+	void        *tmp;
+
+	/* Selection: unvisited children first, then the best UCT score */
+	search->path[length++] = 0;
+	node = &search->nodes[0];
+	STAT_VISIT(search->depth);
+	while (node->children)
+	{
+		log_visits = log(node->visits);
+		best = -1;
+		child = &search->nodes[node->children];
+		for (i = 0; i < __builtin_popcount(node->moves); i++)
+		{
+			if (child[i].visits == 0)
+			{
+				index = node->children + i;
+				break;
+			}
+			score = child[i].wins / child[i].visits +
+				MCTS_EXPLORATION * sqrt(log_visits /
+						child[i].visits);
+			if (score > best)
+			{
+				best = score;
+				index = node->children + i;
+			}
+		}
+		search->path[length++] = index;
+		node = &search->nodes[index];
+		STAT_VISIT(search->depth + length - 1);
+	}
+
+	/* Expansion of a node already played out once, or of the root */
+	if (node->moves && (node->visits || length == 1))
+	{
+		n = __builtin_popcount(node->moves);
+		if (search->size + n > search->capacity)
+		{
+			if (search->capacity > UINT32_MAX / 2)
+				ERROR_EXIT("mcts: too many nodes\n");
+			search->capacity *= 2;
+			tmp = realloc(search->nodes, search->capacity *
+					sizeof(mcts_node_t));
+			if (!tmp)
+			{
+				perror("realloc");
+				exit(errno);
+			}
+			search->nodes = (mcts_node_t *) tmp;
+			node = &search->nodes[index];
+		}
+		first = search->size;
+		search->size += n;
+		for (i = 0, n = 0; i < NUM_CHILDREN; i++)
+		{
+			if (!((node->moves >> i) & 1))
+				continue;
+			child = &search->nodes[first + n++];
+			child->state = node->state - mcts_delta[i];
+			child->moves = mcts_moves(child->state);
+			child->children = 0;
+			child->visits = 0;
+			child->wins = 0;
+		}
+		node->children = first;
+		search->path[length++] = index = first;
+		node = &search->nodes[index];
+		STAT_ADD(nodes_created, n);
+		STAT_VISIT(search->depth + length - 1);
+	}
+
+	/* Side to move at the leaf: 0 for MAX, 1 for MIN */
+	if ((winner = mcts_playout(search, node->state, (length - 1) % 2)) < 0)
+		return 0;
+	STAT_ADD(terminal_evaluations, 1);
+	for (i = 0; i < length; i++)
+	{
+		node = &search->nodes[search->path[i]];
+		node->visits++;
+		/* The node at depth i was reached by a move of side (i-1) % 2 */
+		if (i > 0 && (i - 1) % 2 == winner)
+			node->wins++;
+	}
+	return 1;
+}
+
+
+/* Bitmask of the legal moves of a packed position */
+int mcts_moves(uint64_t state)
+{
+	int i, moves = 0;
+
+	for (i = 0; i < NUM_CHILDREN; i++)
+		if ((pile_t) MCTS_PILE(state, move_pile[i]) >= move_amount[i])
+			moves |= 1 << i;
+	return moves;
+}
+
+
+/*
+ * Plays uniformly random moves from state, side to move first, and
+ * returns the side that makes the last move (0 for MAX, 1 for MIN), or
+ * -1 if the -t deadline passes first.
+ */
+int mcts_playout(mcts_t *search, uint64_t state, int side)
+{
+	long plies = 0;
+	int  moves, n, i;
+
+	while ((moves = mcts_moves(state)))
+	{
+		if (++plies % DEADLINE_CHECK_PLIES == 0 && deadline_given &&
+				past_deadline())
+			return -1;
+		n = mcts_random(search) % __builtin_popcount(moves);
+		for (i = 0; n > 0 || !((moves >> i) & 1); i++)
+			if ((moves >> i) & 1)
+				n--;
+		state -= mcts_delta[i];
+		side = !side;
+	}
+	return !side;
+}
+
+
+/* xorshift64*, one generator per thread */
+uint64_t mcts_random(mcts_t *search)
+{
+	search->rng ^= search->rng >> 12;
+	search->rng ^= search->rng << 25;
+	search->rng ^= search->rng >> 27;
+	return (search->rng * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+
+/*
+ * The transposition table holds one value per (r, g, y, side to move),
+ * expressed for a node of depth 0 (MAX to move) or 1 (MIN to move).
+ * Terminal values depend on the depth they are reached at, but every
+ * node of the same position and side sees the same terminals shifted
+ * by the same number of plies, so ADJUST_VALUE() recovers the value for
+ * any depth and the minimax choice among children is unaffected.
+ */
+void alloc_transposition_table(void)
+{
+	size_t i;
+
+	if (3*M+1 >= SHRT_MAX)
+		ERROR_EXIT("M: should be less than %d when using tt\n",
+				SHRT_MAX/3);
+
+	tt = (short *) malloc(TT_SIZE * sizeof(short));
+	if (!tt)
+	{
+		perror("malloc");
+		exit(errno);
+	}
+	for (i = 0; i < TT_SIZE; i++)
+		tt[i] = TT_EMPTY;
+}
+
+
+/*
+ * Solves every position bottom-up. Each move removes at least one token,
+ * so visiting positions by increasing token count guarantees that all
+ * children of a position are already in the table, and tt_search()
+ * never goes deeper than one level.
+ */
+void retrograde_analysis(void)
+{
+	node_t node;
+	int    total, side;
+
+	memset(&node, 0, sizeof(node_t));
+	for (total = 1; total <= 3*M; total++)
+		for (node.r = MAX(0, total - 2*M); node.r <= MIN(M, total); node.r++)
+			for (node.g = MAX(0, total - node.r - M);
+					node.g <= MIN(M, total - node.r); node.g++)
+			{
+				node.y = total - node.r - node.g;
+				for (side = 0; side < 2; side++)
+				{
+					node.depth = side;
+					POLICY_CALL(tt_search, &node);
+				}
+			}
+}
+
+
+/*
+ * Maps a table previously written by save_outcome_table(). Returns 0 if
+ * the file does not exist; a file computed for other parameters or for
+ * the other MIN policy is refused rather than overwritten.
+ */
+int load_outcome_table(char *path)
+{
+	table_header_t *header;
+	struct stat     st;
+	int             fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return 0;
+	if (fstat(fd, &st) == -1)
+	{
+		perror("fstat");
+		exit(errno);
+	}
+	if ((size_t) st.st_size < sizeof(table_header_t))
+		ERROR_EXIT("%s: not an outcome table\n", path);
+
+	tt_mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (tt_mapping == MAP_FAILED)
+	{
+		perror("mmap");
+		exit(errno);
+	}
+	tt_mapping_size = st.st_size;
+
+	header = (table_header_t *) tt_mapping;
+	if (memcmp(header->magic, TABLE_MAGIC, sizeof(header->magic)) ||
+			header->entries != (st.st_size - sizeof(table_header_t)) /
+			sizeof(short))
+		ERROR_EXIT("%s: not an outcome table\n", path);
+	if (header->m != M || header->k1 != K1 || header->k2 != K2 ||
+			header->k3 != K3 || header->min_policy != min_optimal)
+		ERROR_EXIT("%s: table computed for %d %d %d %d with %s MIN, "
+				"not %lld %lld %lld %lld with %s MIN\n", path,
+				header->m, header->k1, header->k2, header->k3,
+				(header->min_policy) ? "optimal" : "nonoptimal",
+				M, K1, K2, K3, (min_optimal) ? "optimal" : "nonoptimal");
+	if (header->entries != TT_SIZE)
+		ERROR_EXIT("%s: not an outcome table\n", path);
+
+	tt = (short *) (header + 1);
+	return 1;
+}
+
+
+void save_outcome_table(char *path)
+{
+	table_header_t header;
+	FILE          *outfile;
+
+	memset(&header, 0, sizeof(table_header_t));
+	memcpy(header.magic, TABLE_MAGIC, sizeof(header.magic));
+	header.m = M;
+	header.k1 = K1;
+	header.k2 = K2;
+	header.k3 = K3;
+	header.min_policy = min_optimal;
+	header.entries = TT_SIZE;
+
+	if (!(outfile = fopen(path, "wb")))
+	{
+		perror("fopen");
+		return;
+	}
+	if (fwrite(&header, sizeof(table_header_t), 1, outfile) != 1 ||
+			fwrite(tt, sizeof(short), TT_SIZE, outfile) != TT_SIZE)
+		perror("fwrite");
+	fclose(outfile);
+}
+
+
+/*
+ * The game is impartial and every pile is an independent subtraction
+ * game with moves {1, Ki}, so (Sprague-Grundy) a position is lost for
+ * the player to move iff the XOR of the Grundy values of its piles is 0.
+ * Piles with the same K share their Grundy sequence.
+ */
+void compute_grundy_values(void)
+{
+	int pile, i;
+
+	for (pile = 0; pile < num_piles; pile++)
+	{
+		for (i = 0; i < pile; i++)
+			if (removal_count[i] == removal_count[pile] &&
+					!memcmp(removals[i], removals[pile],
+					removal_count[i] * sizeof(pile_t)))
+				break;
+		if (i < pile)
+		{
+			grundy[pile] = grundy[i];
+			continue;
+		}
+		grundy[pile] = (grundy_seq_t *) malloc(sizeof(grundy_seq_t));
+		if (!grundy[pile])
+		{
+			perror("malloc");
+			exit(errno);
+		}
+		grundy[pile]->moves = removals[pile];
+		grundy[pile]->size = removal_count[pile];
+		grundy[pile]->k = removals[pile][removal_count[pile] - 1];
+		detect_grundy_period(grundy[pile]);
+	}
+}
+
+
+/*
+ * The Grundy value of n only depends on the k values before it, so the
+ * sequence becomes periodic as soon as a window of k values repeats.
+ * Windows are compared through a rolling hash kept in an open-addressing
+ * table (verified on a hash match), which finds the first repetition in
+ * time linear in the preperiod plus the period. The preperiod is then
+ * shrunk as far as the sequence allows. The classic moves {1, k} need
+ * no table: n alternates between 0 and 1 for an odd k, and for an even
+ * k, the values repeat 0 1 0 1 ... 0 1 2 with period k+1.
+ */
+void detect_grundy_period(grundy_seq_t *seq)
+{
+	unsigned char *values = NULL;
+	uint64_t      *window = NULL, hash = 0, top = 1;
+	int            i;
+	pile_t        *slots = NULL, n, a = 0, length = 0, capacity = 0,
+		       mask = 0, j, k = seq->k;
+	void          *tmp;
+
+	if (seq->size == 2 && seq->moves[0] == 1)
+	{
+		seq->preperiod = 0;
+		seq->period = (k & 1) ? 2 : k + 1;
+		seq->values = NULL;
+		return;
+	}
+
+	for (n = 1; n < k; n++)
+		top *= GRUNDY_HASH_BASE;
+
+	for (n = 0; ; n++)
+	{
+		if (n == length)
+		{
+			length = (length) ? 2 * length : 2 * k + 2;
+			if (!(tmp = realloc(values, length)))
+			{
+				perror("realloc");
+				exit(errno);
+			}
+			values = (unsigned char *) tmp;
+			if (!(tmp = realloc(window, length * sizeof(uint64_t))))
+			{
+				perror("realloc");
+				exit(errno);
+			}
+			window = (uint64_t *) tmp;
+		}
+		/* The smallest value that no move from n leads to */
+		values[n] = 0;
+		for (i = 0; i < seq->size; i++)
+			if (n >= seq->moves[i] &&
+					values[n - seq->moves[i]] == values[n])
+				values[n]++, i = -1;
+		if (n < k)
+		{
+			hash = hash * GRUNDY_HASH_BASE + values[n];
+			continue;
+		}
+
+		/* window[n] is the hash of values[n-k..n-1] */
+		window[n] = hash;
+		hash = (hash - values[n-k] * top) * GRUNDY_HASH_BASE + values[n];
+
+		if (2 * (n - k + 1) > capacity)
+		{
+			free(slots);
+			capacity = (capacity) ? 2 * capacity : 1024;
+			mask = capacity - 1;
+			slots = (pile_t *) malloc(capacity * sizeof(pile_t));
+			if (!slots)
+			{
+				perror("malloc");
+				exit(errno);
+			}
+			for (j = 0; j < capacity; j++)
+				slots[j] = -1;
+			for (a = k; a < n; a++)
+			{
+				for (j = window[a] & mask; slots[j] != -1;
+						j = (j+1) & mask)
+					;
+				slots[j] = a;
+			}
+		}
+		for (j = window[n] & mask; slots[j] != -1; j = (j+1) & mask)
+			if (window[slots[j]] == window[n] && memcmp(values +
+					slots[j] - k, values + n - k, k) == 0)
+				break;
+		if (slots[j] != -1)
+		{
+			a = slots[j];
+			break;
+		}
+		slots[j] = n;
+	}
+
+	seq->period = n - a;
+	seq->preperiod = a - k;
+	while (seq->preperiod > 0 && values[seq->preperiod - 1] ==
+			values[seq->preperiod - 1 + seq->period])
+		seq->preperiod--;
+	seq->values = values;
+	free(window);
+	free(slots);
+}
+
+
+/*
+ * Picks the highest-index move to a position with a zero nim-sum. From a
+ * lost position no move wins against optimal play, so the move removing
+ * the fewest tokens is picked to make the game last longer.
+ */
+void grundy_move(node_t *node)
+{
+	int    i;
+	node_t child;
+
+	next_max_choice = -1;
+	for (i = NUM_CHILDREN-1; i >= 0; i--)
+	{
+		child = *node;
+		if (apply_move(&child, i) && NIM_SUM(&child) == 0)
+		{
+			next_max_choice = i;
+			return;
+		}
+	}
+	for (i = 0; i < NUM_CHILDREN && next_max_choice == -1; i++)
+		if (legal_move(node, i))
+			next_max_choice = i;
+}
+
+
+/*
+ * Cross-checks the Grundy solver against minimax() for every position
+ * with MAX to move: the outcome has to match and the Grundy move has to
+ * keep a won position won. Intended for small M, as minimax() builds
+ * the game tree of each child.
+ */
+int check_grundy(void)
+{
+	node_t  position, *node = &position, child;
+	int     i, value, tmp_value, choice_value, positions = 0, errors = 0;
+
+	if (!min_optimal)
+		ERROR_EXIT("check: requires a MIN that plays optimally\n");
+	compute_grundy_values();
+	alloc_search_stack(3*M+1);
+	node->depth = 0;
+	for (node->r = 0; node->r <= M; node->r++)
+		for (node->g = 0; node->g <= M; node->g++)
+			for (node->y = 0; node->y <= M; node->y++)
+			{
+				if (IS_FINAL_STATE(node))
+					continue;
+				grundy_move(node);
+				value = INT_MIN;
+				choice_value = 0;
+				for (i = 0; i < NUM_CHILDREN; i++)
+				{
+					child = *node;
+					if (!apply_move(&child, i))
+						continue;
+					child.depth++;
+					tmp_value = POLICY_CALL(minimax,
+							build_game_tree(&child));
+					value = MAX(value, tmp_value);
+					if (i == next_max_choice)
+						choice_value = tmp_value;
+				}
+				positions++;
+				if ((value > 0) != (NIM_SUM(node) != 0) ||
+						(value > 0 && choice_value < 0))
+				{
+					errors++;
+					ERROR("Mismatch at (%lld,%lld,%lld): minimax "
+						"%d, nim-sum %d, move %d\n", node->r,
+						node->g, node->y, value,
+						NIM_SUM(node), next_max_choice);
+				}
+			}
+	printf("Checked %d positions: %d mismatches\n", positions, errors);
+	return (errors == 0);
+}
+
+
+int calculate_state_cost(node_t *node)
+{
+	STAT_ADD(terminal_evaluations, 1);
+	if (IS_FINAL_STATE(node))
+	{
+		if (LAST_MOVED_MAX(node))
+#if 1
+			return (MAX_WINNING_VALUE - node->depth);
+#else
+			return (MAX_WINNING_VALUE);
+#endif
+		else
+#if 1
+			return (MIN_WINNING_VALUE + node->depth);
+#else
+			return (MIN_WINNING_VALUE);
+#endif
+	}
+	else
+		ERROR_EXIT("state cost values can only be assigned to terminal nodes");
+}
+
+
+/*
+ * Guesses the value of a non-terminal node by token parity: the game is
+ * assumed to go on with one token removed per move, so the player to
+ * move wins iff an odd number of tokens is left, and to last that long,
+ * which no exact win is slower than. The K removals are ignored, which
+ * keeps the guess cheap and leaves the deeper iterations to correct it.
+ */
+int evaluate_state(node_t *node)
+{
+	long long plies = node->depth + TOKENS(node);
+	int       value = (int) MAX(1, MAX_WINNING_VALUE - plies);
+
+	if ((TOKENS(node) & 1) == MAXIMIZING_PLAYER(node))
+		return value;
+	return -value;
+}
+
+
+int read_option(void)
+{
+	int choice, i;
+
+	do
+	{
+		printf("Enter choice: ");
+		if (scanf("%d", &choice) != 1)
+		{
+			ERROR("scanf: Error reading choice\n");
+		        continue;
+		}
+		if (choice >= 0 && choice < num_moves && VALID_OPTION(choice))
+			break;
+		ERROR("Valid options: ");
+		for (i = 0; i < num_moves; i++)
+			if (options[i])
+				ERROR("%d ", i);
+		ERROR("\n");
+	}
+	while (1);
+	return choice;
+}
+
+
+/*
+ * Plays tournament_games games without any input or board output, MAX
+ * using the selected engine and MIN the opponent agent, and reports the
+ * throughput, the latency of MAX's moves, the outcomes and how often
+ * MAX kept a position won for it. Games are spread over -j threads when
+ * the engine allows it.
+ */
+void run_tournament(void)
+{
+	play_stats_t   *stats;
+	struct timespec start, end;
+	long            moves = 0, max_wins = 0, plies = 0, sum = 0, count = 0,
+	                won_positions = 0, kept_wins = 0;
+	int             i, b, threads = 1;
+	double          elapsed;
+
+	/* Also needed to judge MAX's moves */
+	if (!grundy[0])
+		compute_grundy_values();
+	if (ENGINE_IS_REENTRANT(engine) && num_workers > 0)
+		threads = MIN(num_workers, tournament_games);
+
+	stats = (play_stats_t *) calloc(threads, sizeof(play_stats_t));
+	if (!stats)
+	{
+		perror("calloc");
+		exit(errno);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 1; i < threads; i++)
+		if ((errno = pthread_create(&stats[i].thread, NULL,
+				tournament_worker, &stats[i])))
+		{
+			perror("pthread_create");
+			exit(errno);
+		}
+	tournament_worker(&stats[0]);
+	for (i = 1; i < threads; i++)
+		pthread_join(stats[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = ELAPSED_NS(start, end) / 1e9;
+
+	for (i = 1; i < threads; i++)
+		for (b = 0; b < LATENCY_BUCKETS; b++)
+			stats[0].latencies[b] += stats[i].latencies[b];
+	for (i = 0; i < threads; i++)
+	{
+		moves += stats[i].moves;
+		sum += stats[i].latency_sum;
+		max_wins += stats[i].max_wins;
+		plies += stats[i].plies;
+		won_positions += stats[i].won_positions;
+		kept_wins += stats[i].kept_wins;
+	}
+	/* The p99 latency is the lower bound of its histogram bucket */
+	for (b = 0; b < LATENCY_BUCKETS - 1; b++)
+		if ((count += stats[0].latencies[b]) * 100 >= moves * 99)
+			break;
+	free(stats);
+
+	printf("games: %d, threads: %d, elapsed: %.3f s, games/sec: %.1f\n",
+			tournament_games, threads, elapsed,
+			tournament_games / elapsed);
+	printf("MAX wins: %ld (%.1f%%), MIN wins: %ld (%.1f%%), "
+			"mean length: %.1f plies\n", max_wins,
+			100.0 * max_wins / tournament_games,
+			tournament_games - max_wins,
+			100.0 * (tournament_games - max_wins) / tournament_games,
+			(double) plies / tournament_games);
+	if (moves)
+		printf("MAX move latency: mean %.1f us, p99 %.1f us "
+				"(%ld moves)\n", sum / 1e3 / moves,
+				BUCKET_LATENCY(b) / 1e3, moves);
+	if (won_positions)
+		printf("MAX kept a won position in %ld of %ld moves (%.1f%%)\n",
+				kept_wins, won_positions,
+				100.0 * kept_wins / won_positions);
+}
+
+
+void *tournament_worker(void *arg)
+{
+	play_stats_t *stats = (play_stats_t *) arg;
+	int           game;
+
+	while ((game = __atomic_fetch_add(&next_game, 1, __ATOMIC_RELAXED)) <
+			tournament_games)
+		play_headless(stats, game);
+	return NULL;
+}
+
+
+/* Plays one game as play_game() does; the player who moves last wins */
+void play_headless(play_stats_t *stats, int game)
+{
+	struct timespec start, end;
+	node_t          currnode, child;
+	unsigned int    seed = base_seed + game;
+	int             choice, turn = 0;
+	long            latency;
+
+	currnode.r = currnode.g = currnode.y = M;
+	currnode.depth = 0;
+	if (ENGINE_USES_TREE(engine))
+		root = build_game_tree(&currnode);
+	do
+	{
+		if (MAXIMIZING_PLAYER(&currnode))
+		{
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			decide_max_move(&currnode);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			choice = next_max_choice;
+			latency = ELAPSED_NS(start, end);
+			stats->latencies[LATENCY_BUCKET(latency)]++;
+			stats->latency_sum += latency;
+			stats->moves++;
+			/* A won position is kept by moving to a zero nim-sum */
+			if (NIM_SUM(&currnode))
+			{
+				stats->won_positions++;
+				child = currnode;
+				apply_move(&child, choice);
+				if (!NIM_SUM(&child))
+					stats->kept_wins++;
+			}
+		}
+		else
+			choice = agent_move(&currnode, turn++, &seed);
+		if (ENGINE_USES_TREE(engine))
+			root = advance(root, choice);
+		apply_move(&currnode, choice);
+		currnode.depth++;
+	}
+	while (!IS_FINAL_STATE(&currnode));
+	if (LAST_MOVED_MAX(&currnode))
+		stats->max_wins++;
+	stats->plies += currnode.depth;
+}
+
+
+/*
+ * MIN's move for its turn-th turn of the game. The optimal agent plays
+ * the Grundy strategy, the greedy one removes as many tokens as it can,
+ * the random one picks any legal move, and the scripted one plays the
+ * script's turn-th option (the lowest legal one if that is illegal or
+ * the script has ended).
+ */
+int agent_move(node_t *node, int turn, unsigned int *seed)
+{
+	pile_t best = 0;
+	int    i, n = 0, choice = -1, legal[NUM_CHILDREN];
+
+	for (i = 0; i < NUM_CHILDREN; i++)
+		if (legal_move(node, i))
+			legal[n++] = i;
+
+	switch (opponent)
+	{
+		case OPTIMAL_AGENT:
+			grundy_move(node);
+			return next_max_choice;
+		case GREEDY_AGENT:
+			for (i = 0; i < n; i++)
+				if (move_amount[legal[i]] > best)
+				{
+					best = move_amount[legal[i]];
+					choice = legal[i];
+				}
+			return choice;
+		case RANDOM_AGENT:
+			return legal[rand_r(seed) % n];
+		case SCRIPT_AGENT:
+			if (turn < script_length && script[turn] >= 0 &&
+					script[turn] < NUM_CHILDREN &&
+					legal_move(node, script[turn]))
+				return script[turn];
+			return legal[0];
+	}
+	return legal[0];
+}
+
+
+/* Reads the options of a scripted MIN, as typed at the prompt */
+void load_script(char *path)
+{
+	FILE *fp;
+	int   choice, capacity = 0;
+	void *tmp;
+
+	if (!(fp = fopen(path, "r")))
+	{
+		perror("fopen");
+		exit(errno);
+	}
+	while (fscanf(fp, "%d", &choice) == 1)
+	{
+		if (script_length == capacity)
+		{
+			capacity = (capacity) ? 2 * capacity : 64;
+			if (!(tmp = realloc(script, capacity * sizeof(int))))
+			{
+				perror("realloc");
+				exit(errno);
+			}
+			script = (int *) tmp;
+		}
+		script[script_length++] = choice;
+	}
+	fclose(fp);
+}
+
+
+/* Reads "A" or "A-B" into [lo, hi] */
+void parse_range(char *arg, pile_t *lo, pile_t *hi)
+{
+	char *dash = strchr(arg, '-');
+
+	if (dash)
+		*dash = '\0';
+	*lo = parse_pile(arg);
+	*hi = (dash) ? parse_pile(dash + 1) : *lo;
+	if (dash)
+		*dash = '-';
+	if (*lo < 0 || *hi < *lo)
+		ERROR_EXIT("%s: should be a value or a range A-B\n", arg);
+}
+
+
+/*
+ * Solves every configuration of the ranges given to -w and prints, for
+ * each one with its K values below M, the winner under optimal play and
+ * the opening move of the grundy engine. The Grundy sequence of each K
+ * is computed once and shared by every pile and M with that K: as it is
+ * periodic, it answers for any M. The sequences, then the configurations,
+ * are spread over -j threads, all cores by default.
+ */
+void run_sweep(void)
+{
+	pile_t k, m, k1, k2, k3;
+	long   index = 0;
+	int    i, result;
+
+	sweep_kmin = MIN(sweep_lo[1], MIN(sweep_lo[2], sweep_lo[3]));
+	sweep_kmax = MIN(MAX(sweep_hi[1], MAX(sweep_hi[2], sweep_hi[3])),
+			sweep_hi[0] - 1);
+	sweep_piles = (sweep_pile_t *) calloc(MAX(sweep_kmax - sweep_kmin + 1,
+				1), sizeof(sweep_pile_t));
+	if (!sweep_piles)
+	{
+		perror("calloc");
+		exit(errno);
+	}
+	for (k = sweep_kmin; k <= sweep_kmax; k++)
+		for (i = 1; i < 4; i++)
+			if (k >= sweep_lo[i] && k <= sweep_hi[i])
+				sweep_piles[k - sweep_kmin].used = 1;
+
+	sweep_size = sweep_hi[0] - sweep_lo[0] + 1;
+	for (i = 1; i < 4; i++)
+		sweep_size *= sweep_hi[i] - sweep_lo[i] + 1;
+	sweep_results = (signed char *) malloc(sweep_size);
+	if (!sweep_results)
+	{
+		perror("malloc");
+		exit(errno);
+	}
+
+	if (num_workers <= 0)
+		num_workers = MAX(1, (int) sysconf(_SC_NPROCESSORS_ONLN));
+	run_sweep_threads(sweep_grundy_worker);
+	run_sweep_threads(sweep_worker);
+
+	printf("# M K1 K2 K3 WINNER MOVE\n");
+	for (m = sweep_lo[0]; m <= sweep_hi[0]; m++)
+		for (k1 = sweep_lo[1]; k1 <= sweep_hi[1]; k1++)
+			for (k2 = sweep_lo[2]; k2 <= sweep_hi[2]; k2++)
+				for (k3 = sweep_lo[3]; k3 <= sweep_hi[3]; k3++)
+				{
+					result = sweep_results[index++];
+					if (result != SWEEP_INVALID)
+						printf("%lld %lld %lld %lld %s %d\n",
+								m, k1, k2, k3,
+								(result & 8) ? "MAX" :
+								"MIN", result & 7);
+				}
+
+	for (k = sweep_kmin; k <= sweep_kmax; k++)
+		free(sweep_piles[k - sweep_kmin].seq.values);
+	free(sweep_piles);
+	free(sweep_results);
+}
+
+
+/* Runs worker on num_workers threads, the calling one included */
+void run_sweep_threads(void *(*worker)(void *))
+{
+	pthread_t *threads;
+	int        i;
+
+	threads = (pthread_t *) malloc(num_workers * sizeof(pthread_t));
+	if (!threads)
+	{
+		perror("malloc");
+		exit(errno);
+	}
+	sweep_next = 0;
+	for (i = 1; i < num_workers; i++)
+		if ((errno = pthread_create(&threads[i], NULL, worker, NULL)))
+		{
+			perror("pthread_create");
+			exit(errno);
+		}
+	worker(NULL);
+	for (i = 1; i < num_workers; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+
+/* Computes the Grundy sequences of the K values of the sweep, one at a time */
+void *sweep_grundy_worker(void *arg)
+{
+	sweep_pile_t *pile;
+	pile_t        k;
+
+	while ((k = sweep_kmin + __atomic_fetch_add(&sweep_next, 1,
+			__ATOMIC_RELAXED)) <= sweep_kmax)
+	{
+		pile = &sweep_piles[k - sweep_kmin];
+		if (!pile->used)
+			continue;
+		pile->moves[0] = 1;
+		pile->moves[1] = k;
+		pile->seq.moves = pile->moves;
+		pile->seq.size = 2;
+		pile->seq.k = k;
+		detect_grundy_period(&pile->seq);
+	}
+	return arg;
+}
+
+
+/* Solves the configurations of the sweep, SWEEP_CHUNK at a time */
+void *sweep_worker(void *arg)
+{
+	long index, last;
+
+	while ((index = __atomic_fetch_add(&sweep_next, SWEEP_CHUNK,
+			__ATOMIC_RELAXED)) < sweep_size)
+		for (last = MIN(index + SWEEP_CHUNK, sweep_size); index < last;
+				index++)
+			sweep_results[index] = sweep_config(index);
+	return arg;
+}
+
+
+/*
+ * Solves the configuration of the sweep at index, the M values varying
+ * the slowest and the K3 values the fastest: the same choice as
+ * grundy_move(), from M tokens in every pile.
+ */
+int sweep_config(long index)
+{
+	grundy_seq_t *seq[3];
+	pile_t        m, k[3], amount;
+	int           i, p, sum = 0;
+
+	for (p = 2; p >= 0; p--)
+	{
+		k[p] = sweep_lo[p+1] + index % (sweep_hi[p+1] - sweep_lo[p+1] + 1);
+		index /= sweep_hi[p+1] - sweep_lo[p+1] + 1;
+	}
+	m = sweep_lo[0] + index;
+	for (p = 0; p < 3; p++)
+	{
+		if (k[p] >= m)
+			return SWEEP_INVALID;
+		seq[p] = &sweep_piles[k[p] - sweep_kmin].seq;
+		sum ^= GRUNDY_VALUE(seq[p], m);
+	}
+
+	/* The moves of build_classic_moves(), for these K */
+	for (i = NUM_CHILDREN-1; i >= 0; i--)
+	{
+		p = move_pile[i];
+		amount = (move_rank[i] == 0) ? 1 : k[p];
+		if ((sum ^ GRUNDY_VALUE(seq[p], m) ^
+				GRUNDY_VALUE(seq[p], m - amount)) == 0)
+			return SWEEP_RESULT(1, i);
+	}
+	return SWEEP_RESULT(0, 0);
+}
+
+
+/*
+ * Benchmark mode: prints one CSV row with the time taken to prepare the
+ * engine, to build the full game tree (tree engines only), to choose
+ * MAX's first move and to free the tree, along with the node counters
+ * of a SEARCH_STATS build and the peak resident set size.
+ */
+void run_bench(void)
+{
+	struct timespec t0, t1, t2, t3, t4;
+	struct rusage   usage;
+	node_t          position;
+	uint32_t        i;
+	double          search_time, nodes, memory;
+
+	position.r = position.g = position.y = M;
+	position.depth = 0;
+
+	/* A tree that would not fit in memory or in tree[] is skipped */
+	if (ENGINE_USES_TREE(engine))
+	{
+		memory = (double) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+		nodes = count_tree_nodes(UINT32_MAX / 2);
+		if (isinf(nodes))
+		{
+			ERROR("bench: skipping %s %lld %lld %lld %lld, its tree has "
+					"more than %u nodes\n", engine_names[engine],
+					M, K1, K2, K3, UINT32_MAX / 2);
+			return;
+		}
+		if (nodes * sizeof(tree_node_t) > memory)
+		{
+			ERROR("bench: skipping %s %lld %lld %lld %lld, its tree of "
+					"%.0f nodes needs %.0f MB out of %.0f MB\n",
+					engine_names[engine], M, K1, K2, K3, nodes,
+					nodes * sizeof(tree_node_t) / (1 << 20),
+					memory / (1 << 20));
+			return;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	prepare_engine();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (ENGINE_USES_TREE(engine))
+	{
+		/* Expanding nodes in index order builds the tree breadth-first */
+		root = build_game_tree(&position);
+		for (i = 0; i < tree_size; i++)
+			build_next_level(i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	decide_max_move(&position);
+	clock_gettime(CLOCK_MONOTONIC, &t3);
+	free_game_tree();
+	clock_gettime(CLOCK_MONOTONIC, &t4);
+	getrusage(RUSAGE_SELF, &usage);
+
+	/* Retrograde analysis visits its nodes while preparing the engine */
+	search_time = (ELAPSED_NS(t0, t1) + ELAPSED_NS(t2, t3)) / 1e9;
+	printf("%s,%s,%lld,%lld,%lld,%lld,%d,%ld,%ld,%.6f,%.6f,%.6f,%.6f,"
+			"%.0f,%ld\n", engine_names[engine],
+			(min_optimal) ? "optimal" : "nonoptimal", M, K1, K2, K3,
+			next_max_choice, search_stats.nodes_created,
+			search_stats.nodes_visited, ELAPSED_NS(t0, t1) / 1e9,
+			ELAPSED_NS(t1, t2) / 1e9, ELAPSED_NS(t2, t3) / 1e9,
+			ELAPSED_NS(t3, t4) / 1e9,
+			(search_time > 0) ? search_stats.nodes_visited /
+			search_time : 0, usage.ru_maxrss);
+}
+
+
+/*
+ * Nodes of the full game tree from M tokens in every pile, counted over
+ * positions (a child takes one pile down, so index order is bottom-up),
+ * or INFINITY if there are more than 'limit'. Every interleaving of
+ * single token removals is a path of the tree, so (3M)!/(M!)^3 bounds
+ * the count from below and rules out large M without counting.
+ */
+double count_tree_nodes(double limit)
+{
+	double *count, total;
+	node_t  node, child;
+	int     i;
+
+	if (lgamma(3.0*M + 1) - 3 * lgamma(M + 1.0) > log(limit))
+		return INFINITY;
+	count = (double *) malloc(TT_SIZE / 2 * sizeof(double));
+	if (!count)
+	{
+		perror("malloc");
+		exit(errno);
+	}
+	/* At depth 0, TT_INDEX() / 2 numbers the positions */
+	memset(&node, 0, sizeof(node_t));
+	for (node.r = 0; node.r <= M; node.r++)
+		for (node.g = 0; node.g <= M; node.g++)
+			for (node.y = 0; node.y <= M; node.y++)
+			{
+				total = 1;
+				for (i = 0; i < NUM_CHILDREN; i++)
+				{
+					child = node;
+					if (apply_move(&child, i))
+						total += count[TT_INDEX(&child) / 2];
+				}
+				count[TT_INDEX(&node) / 2] = total;
+			}
+	total = count[TT_SIZE / 2 - 1];
+	free(count);
+	return (total > limit) ? INFINITY : total;
+}
+
+
+/*
+ * Prints the counters of the last MAX move, and the memory held by the
+ * tree and the transposition table, then resets the counters.
+ */
+void print_search_stats(void)
+{
+	int i;
+
+	printf("Search statistics:\n");
+	printf("\tnodes created: %ld, visited: %ld, terminal: %ld\n",
+			search_stats.nodes_created, search_stats.nodes_visited,
+			search_stats.terminal_evaluations);
+	printf("\tillegal moves: %ld, table hits: %ld, cutoffs: %ld\n",
+			search_stats.illegal_moves, search_stats.table_hits,
+			search_stats.cutoffs);
+	printf("\tvisited per depth:");
+	for (i = 0; i < STATS_DEPTHS; i++)
+		if (search_stats.depth_visits[i])
+			printf(" %d%s:%ld", i, (i == STATS_DEPTHS-1) ? "+" : "",
+					search_stats.depth_visits[i]);
+	printf("\n\tmemory: tree %zu KB (%u nodes), table %zu KB\n",
+			(size_t) (tree_capacity + spare_capacity) *
+			sizeof(tree_node_t) / 1024, tree_size,
+			(tt) ? (size_t) TT_SIZE * sizeof(short) / 1024 : 0);
+	memset(&search_stats, 0, sizeof(search_stats_t));
+}
+
+
+void free_memory(void)
+{
+	int i, j;
+
+	stop_workers();
+	free_game_tree();
+	free(killer);
+	free(search_stack);
+	for (i = 0; i < mcts_count; i++)
+	{
+		free(mcts_threads[i].nodes);
+		free(mcts_threads[i].path);
+	}
+	free(mcts_threads);
+	free(script);
+	if (tt_mapping)
+		munmap(tt_mapping, tt_mapping_size);
+	else
+		free(tt);
+	for (i = 0; i < num_piles; i++)
+	{
+		for (j = 0; j < i && grundy[j] != grundy[i]; j++)
+			;
+		if (!grundy[i] || j < i)
+			continue;
+		free(grundy[i]->values);
+		free(grundy[i]);
+	}
+}
+
+
+void free_game_tree(void)
+{
+	free(tree);
+	free(spare_tree);
+	tree = spare_tree = NULL;
+	tree_size = tree_capacity = spare_capacity = 0;
+}
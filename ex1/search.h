@@ -0,0 +1,490 @@
+/*
+ * +-----------------------------------------------------------------------+
+ * |                Copyright (C) 2018 George Z. Zachos                    |
+ * +-----------------------------------------------------------------------+
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Name: George Z. Zachos
+ * Email: gzzachos <at> gmail.com
+ */
+
+/*
+ * Search engines of game.c, written once for both MIN policies. game.c
+ * includes this file once per policy, with MIN_OPTIMAL set to 1 (MIN
+ * minimizes) or 0 (MIN maximizes, starting from 0) and POLICY(name)
+ * mangling each function name, so the policy costs no branch per node.
+ * With POLICY_PROTOTYPES defined, only the prototypes are declared.
+ */
+
+#ifdef POLICY_PROTOTYPES
+int     POLICY(minimax)(uint32_t index);
+int     POLICY(alphabeta)(uint32_t index, int alpha, int beta);
+int     POLICY(tt_search)(node_t *root);
+int     POLICY(parallel_search)(node_t *node, int alpha, int beta,
+		split_t *parent, worker_t *worker);
+int     POLICY(split_search)(node_t *node, int *order, int first,
+		int alpha, int beta, int bestvalue, split_t *parent,
+		worker_t *worker);
+int     POLICY(deepening_search)(node_t *root, int alpha, int beta,
+		int depth_left);
+#else
+/*
+ * Minimax value of the node at index. The tree is searched depth-first
+ * on search_stack[], with one frame per node of the current path, as
+ * deep games would overflow the call stack. Children that mirror an
+ * earlier sibling have its value and are not searched.
+ */
+int POLICY(minimax)(uint32_t index)
+{
+	search_frame_t *top = search_stack;
+	int             i, n, value;
+	node_t          node;
+
+	top->index = index;
+	for (;;)
+	{
+		unpack_state(tree[top->index].state, &node);
+		STAT_VISIT(node.depth);
+		if (tree[top->index].value != TREE_NO_VALUE)
+		{
+			STAT_ADD(table_hits, 1);
+			value = tree[top->index].value;
+		}
+		else if (IS_FINAL_STATE(&node))
+			value = STATE_COST(&node);
+		else
+		{
+			/* A non-terminal node has at least one move to search */
+			build_next_level(top->index);
+			for (i = 0, n = 0; i < NUM_CHILDREN; i++)
+				if (HAS_MOVE(&tree[top->index], i) &&
+						mirror_move(&node, i) == i)
+					top->order[n++] = i;
+			if (n < NUM_CHILDREN)
+				top->order[n] = -1;
+#if MIN_OPTIMAL
+			top->minimizing = !MAXIMIZING_PLAYER(&node);
+			top->bestvalue = (top->minimizing) ? INT_MAX : INT_MIN;
+#else
+			top->minimizing = 0;
+			top->bestvalue = (MAXIMIZING_PLAYER(&node)) ? INT_MIN : 0;
+#endif
+			top->k = 1;
+			top[1].index = CHILD_INDEX(&tree[top->index],
+					top->order[0]);
+			top++;
+			continue;
+		}
+
+		/* Passes value up to the first node with a move left to search */
+		for (;;)
+		{
+			if (top == search_stack)
+				return value;
+			top--;
+#if MIN_OPTIMAL
+			if (top->minimizing)
+				top->bestvalue = MIN(top->bestvalue, value);
+			else
+#endif
+				top->bestvalue = MAX(top->bestvalue, value);
+			if (top->k < NUM_CHILDREN &&
+					(i = top->order[top->k]) != -1)
+			{
+				top->k++;
+				top[1].index = CHILD_INDEX(&tree[top->index], i);
+				top++;
+				break;
+			}
+			value = tree[top->index].value = top->bestvalue;
+		}
+	}
+}
+
+
+/*
+ * Fail-soft alpha-beta pruning. The returned value is exact if it lies
+ * within (alpha, beta), otherwise it is a bound on the minimax value.
+ * Like minimax(), it searches on search_stack[] rather than recursing,
+ * and caches the values of the nodes that it finds exactly.
+ */
+int POLICY(alphabeta)(uint32_t index, int alpha, int beta)
+{
+	search_frame_t *top = search_stack;
+	int             i, value;
+	node_t          node;
+
+	top->index = index;
+	top->alpha = alpha;
+	top->beta = beta;
+	for (;;)
+	{
+		unpack_state(tree[top->index].state, &node);
+		STAT_VISIT(node.depth);
+		if (tree[top->index].value != TREE_NO_VALUE)
+		{
+			STAT_ADD(table_hits, 1);
+			value = tree[top->index].value;
+		}
+		else if (IS_FINAL_STATE(&node))
+			value = STATE_COST(&node);
+		else
+		{
+			/* No terminal below can be reached before the next move */
+			top->alpha = MAX(top->alpha,
+					MIN_WINNING_VALUE + node.depth + 1);
+			top->beta = MIN(top->beta,
+					MAX_WINNING_VALUE - node.depth - 1);
+			value = top->alpha;
+#if MIN_OPTIMAL
+			top->minimizing = !MAXIMIZING_PLAYER(&node);
+			top->bestvalue = (top->minimizing) ? INT_MAX : INT_MIN;
+#else
+			/* A MIN that does not play optimally maximizes, starting from 0 */
+			top->minimizing = 0;
+			top->bestvalue = (MAXIMIZING_PLAYER(&node)) ? INT_MIN : 0;
+			if (top->alpha < top->beta)
+				value = top->alpha = MAX(top->alpha, top->bestvalue);
+#endif
+			if (top->alpha < top->beta)
+			{
+				build_next_level(top->index);
+				order_moves(top->index, top->order);
+				top->lower = top->alpha;
+				top->upper = top->beta;
+				top->depth = node.depth;
+				top->k = 1;
+				top[1].index = CHILD_INDEX(&tree[top->index],
+						top->order[0]);
+				top[1].alpha = top->alpha;
+				top[1].beta = top->beta;
+				top++;
+				continue;
+			}
+		}
+
+		/* Passes value up to the first node with a move left to search */
+		for (;;)
+		{
+			if (top == search_stack)
+				return value;
+			top--;
+			if (top->minimizing)
+			{
+				top->bestvalue = MIN(top->bestvalue, value);
+				top->beta = MIN(top->beta, value);
+			}
+			else
+			{
+				top->bestvalue = MAX(top->bestvalue, value);
+				top->alpha = MAX(top->alpha, value);
+			}
+			if (top->alpha >= top->beta)
+			{
+				STAT_ADD(cutoffs, 1);
+				killer[top->depth] = top->order[top->k - 1];
+			}
+			else if (top->k < NUM_CHILDREN &&
+					(i = top->order[top->k]) != -1)
+			{
+				top->k++;
+				top[1].index = CHILD_INDEX(&tree[top->index], i);
+				top[1].alpha = top->alpha;
+				top[1].beta = top->beta;
+				top++;
+				break;
+			}
+			value = top->bestvalue;
+			/* Fail-soft values inside the entry window are exact */
+			if (value > top->lower && value < top->upper)
+				tree[top->index].value = value;
+		}
+	}
+}
+
+
+/*
+ * Memoized minimax over positions, without building a tree. Positions
+ * share the entry of their canonical_position(). Like minimax(), it
+ * searches on search_stack[], which only holds the positions that are
+ * expanded: a position that is final or already in the table is valued
+ * without touching it, so retrograde tournaments may call it from
+ * several threads once the table is complete.
+ */
+int POLICY(tt_search)(node_t *root)
+{
+	search_frame_t *top = search_stack;
+	int             i, n, value;
+	short          *entry;
+	node_t          node = *root, key;
+
+	for (;;)
+	{
+		STAT_VISIT(node.depth);
+		if (IS_FINAL_STATE(&node))
+			value = STATE_COST(&node);
+		else
+		{
+			key = node;
+			canonical_position(&key);
+			entry = &tt[TT_INDEX(&key)];
+			if (*entry != TT_EMPTY)
+			{
+				STAT_ADD(table_hits, 1);
+				value = ADJUST_VALUE(*entry, node.depth & 1,
+						node.depth);
+			}
+			else
+			{
+				top->node = node;
+				top->entry = entry;
+				for (i = 0, n = 0; i < NUM_CHILDREN; i++)
+				{
+					key = node;
+					if (!apply_move(&key, i))
+						STAT_ADD(illegal_moves, 1);
+					else if (mirror_move(&node, i) == i)
+						top->order[n++] = i;
+				}
+				if (n < NUM_CHILDREN)
+					top->order[n] = -1;
+#if MIN_OPTIMAL
+				top->minimizing = !MAXIMIZING_PLAYER(&node);
+				top->bestvalue = (top->minimizing) ? INT_MAX : INT_MIN;
+#else
+				top->minimizing = 0;
+				top->bestvalue = (MAXIMIZING_PLAYER(&node)) ? INT_MIN : 0;
+#endif
+				top->k = 1;
+				apply_move(&node, top->order[0]);
+				node.depth++;
+				top++;
+				continue;
+			}
+		}
+
+		/* Passes value up to the first position with a move left */
+		for (;;)
+		{
+			if (top == search_stack)
+				return value;
+			top--;
+#if MIN_OPTIMAL
+			if (top->minimizing)
+				top->bestvalue = MIN(top->bestvalue, value);
+			else
+#endif
+				top->bestvalue = MAX(top->bestvalue, value);
+			if (top->k < NUM_CHILDREN &&
+					(i = top->order[top->k]) != -1)
+			{
+				top->k++;
+				node = top->node;
+				apply_move(&node, i);
+				node.depth++;
+				top++;
+				break;
+			}
+			value = top->bestvalue;
+			*top->entry = ADJUST_VALUE(value, top->node.depth,
+					top->node.depth & 1);
+		}
+	}
+}
+
+
+/* Position-based alphabeta() that splits its node when a worker idles */
+int POLICY(parallel_search)(node_t *node, int alpha, int beta,
+		split_t *parent, worker_t *worker)
+{
+	int    bestvalue, minimizing = 0, i, k, tmp_value, order[NUM_CHILDREN];
+	node_t child;
+
+	STAT_VISIT(node->depth);
+	if (IS_FINAL_STATE(node))
+		return STATE_COST(node);
+
+	alpha = MAX(alpha, MIN_WINNING_VALUE + node->depth + 1);
+	beta = MIN(beta, MAX_WINNING_VALUE - node->depth - 1);
+	if (alpha >= beta)
+		return alpha;
+
+#if MIN_OPTIMAL
+	minimizing = !MAXIMIZING_PLAYER(node);
+	bestvalue = (minimizing) ? INT_MAX : INT_MIN;
+#else
+	bestvalue = (MAXIMIZING_PLAYER(node)) ? INT_MIN : 0;
+	alpha = MAX(alpha, bestvalue);
+	if (alpha >= beta)
+		return alpha;
+#endif
+	order_positions(node, order);
+	for (k = 0; k < NUM_CHILDREN && (i = order[k]) != -1; k++)
+	{
+		if (ABORTED(parent))
+			return bestvalue;
+		if (k > 0 && k < NUM_CHILDREN - 1 && order[k+1] != -1 &&
+				__atomic_load_n(&idle_workers, __ATOMIC_RELAXED) &&
+				TOKENS(node) >= SPLIT_MIN_TOKENS)
+			return POLICY(split_search)(node, order, k, alpha, beta,
+					bestvalue, parent, worker);
+		child = *node;
+		apply_move(&child, i);
+		child.depth++;
+		tmp_value = POLICY(parallel_search)(&child, alpha, beta, parent,
+				worker);
+		if (minimizing)
+		{
+			bestvalue = MIN(bestvalue, tmp_value);
+			beta = MIN(beta, tmp_value);
+		}
+		else
+		{
+			bestvalue = MAX(bestvalue, tmp_value);
+			alpha = MAX(alpha, tmp_value);
+		}
+		if (alpha >= beta)
+		{
+			STAT_ADD(cutoffs, 1);
+			break;
+		}
+	}
+	return bestvalue;
+}
+
+
+/* Searches the moves of node from order[first] on as tasks of a new split */
+int POLICY(split_search)(node_t *node, int *order, int first, int alpha,
+		int beta, int bestvalue, split_t *parent, worker_t *worker)
+{
+	split_t split;
+	int     k;
+
+	memset(&split, 0, sizeof(split_t));
+	pthread_mutex_init(&split.lock, NULL);
+	split.parent = parent;
+	split.node = *node;
+	split.alpha = alpha;
+	split.beta = beta;
+	split.bestvalue = bestvalue;
+	split.search = POLICY(parallel_search);
+#if MIN_OPTIMAL
+	split.minimizing = !MAXIMIZING_PLAYER(node);
+#endif
+	for (k = first; k < NUM_CHILDREN && order[k] != -1; k++)
+		split.pending++;
+	/* Pushed in reverse, so that the owner pops them in order */
+	while (k-- > first)
+		push_task(worker, &split, order[k]);
+	wait_split(worker, &split);
+	pthread_mutex_destroy(&split.lock);
+	return split.bestvalue;
+}
+
+
+/*
+ * alphabeta() over positions, which evaluates the nodes 'depth_left'
+ * plies below the root of the iteration with evaluate_state(). Expanded
+ * positions take a frame of search_stack[], which deepening_move() sizes
+ * for the depth of the iteration.
+ */
+int POLICY(deepening_search)(node_t *root, int alpha, int beta,
+		int depth_left)
+{
+	search_frame_t *top = search_stack;
+	int             i, value;
+	node_t          node = *root;
+
+	for (;;)
+	{
+		STAT_VISIT(node.depth);
+		if (IS_FINAL_STATE(&node))
+			value = STATE_COST(&node);
+		else
+		{
+			if (++search_nodes % DEADLINE_CHECK_NODES == 0 &&
+					past_deadline())
+				search_timeout = 1;
+			/* The iteration is discarded, whatever its value */
+			if (search_timeout)
+				return 0;
+			if (top - search_stack == depth_left)
+			{
+				search_estimated = 1;
+				value = evaluate_state(&node);
+			}
+			else
+			{
+				alpha = MAX(alpha, MIN_WINNING_VALUE + node.depth + 1);
+				beta = MIN(beta, MAX_WINNING_VALUE - node.depth - 1);
+				value = alpha;
+#if MIN_OPTIMAL
+				top->minimizing = !MAXIMIZING_PLAYER(&node);
+				top->bestvalue = (top->minimizing) ? INT_MAX : INT_MIN;
+#else
+				top->minimizing = 0;
+				top->bestvalue = (MAXIMIZING_PLAYER(&node)) ? INT_MIN : 0;
+				if (alpha < beta)
+					value = alpha = MAX(alpha, top->bestvalue);
+#endif
+				if (alpha < beta)
+				{
+					top->node = node;
+					top->alpha = alpha;
+					top->beta = beta;
+					order_positions(&node, top->order);
+					top->k = 1;
+					apply_move(&node, top->order[0]);
+					node.depth++;
+					top++;
+					continue;
+				}
+			}
+		}
+
+		/* Passes value up to the first position with a move left */
+		for (;;)
+		{
+			if (top == search_stack)
+				return value;
+			top--;
+			if (top->minimizing)
+			{
+				top->bestvalue = MIN(top->bestvalue, value);
+				top->beta = MIN(top->beta, value);
+			}
+			else
+			{
+				top->bestvalue = MAX(top->bestvalue, value);
+				top->alpha = MAX(top->alpha, value);
+			}
+			if (top->alpha >= top->beta)
+				STAT_ADD(cutoffs, 1);
+			else if (top->k < NUM_CHILDREN &&
+					(i = top->order[top->k]) != -1)
+			{
+				top->k++;
+				node = top->node;
+				apply_move(&node, i);
+				node.depth++;
+				alpha = top->alpha;
+				beta = top->beta;
+				top++;
+				break;
+			}
+			value = top->bestvalue;
+		}
+	}
+}
+#endif
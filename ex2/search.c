@@ -25,6 +25,9 @@
 #include <time.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 
 /* Global definitions */
 #define USE_GRAPHVIZ
@@ -38,41 +41,115 @@
 #define ERROR(...)          { fprintf(stderr, __VA_ARGS__); }
 #define ERROR_EXIT(...)     { ERROR(__VA_ARGS__); exit(EXIT_FAILURE); }
 #define ERROR_RETURNV(...)  { ERROR(__VA_ARGS__); return; }
-#define IN_CLOSEDSET(x)     ((x)->visited)
-#define _H(k,l)             heuristic_cost_estimate((k)->vector,(l)->vector)
+#define NO_PARENT           UINT32_MAX
+#define FLAG_VISITED        0x01
+#define FLAG_FRONTIER       0x02
+#define IN_CLOSEDSET(x)     (flags[x] & FLAG_VISITED)
+#define IN_FRONTIER(x)      (flags[x] & FLAG_FRONTIER)
+#define _H(k,l)             heuristic_cost_estimate(state_space[k],state_space[l])
 #define _G(k,l)             _H(k,l)
 #define EDGE_COST(x,y)      heuristic_cost_estimate(x,y) // For Graphviz
+#define FRONTIER_LESS(x,y)  (f[x] < f[y] || (f[x] == f[y] && seq[x] < seq[y]))
+#define USAGE               "USAGE: %s [-r] [-q FILE|-] [-s SEED] [-k WIDTH [-l]] " \
+                            "L M d N\n"
+#define STREAM_BLOCK_SIZE   (1 << 20)
+#define STREAM_BATCH_SIZE   4096
+/* Four ints, "astar", a %.1f float (up to 42 chars), " 0", '\n' and '\0' */
+#define STREAM_RECORD_SIZE  128
+#define PIPE_CAPACITY       8
 #define A_STAR(s, g, sol)   a_star(s, g, sol, 0)
 #define UCS(s, g, sol)      a_star(s, g, sol, 1)
+#define REACHED(x)          (parent[x] != NO_PARENT)
+#define BEAM_LESS(a,b)      ((a).e < (b).e || ((a).e == (b).e && (a).seq < (b).seq))
+#define BEAM_BEFORE(a,b,max) ((max) ? BEAM_LESS(b,a) : BEAM_LESS(a,b))
+#define BEAM_STALE(x)       (!IN_FRONTIER((x).state) || f[(x).state] != (x).e)
+#define MAX_LEVEL(i)        ((31 - __builtin_clz((i) + 1)) % 2)
 #define EXPANSION_PERC(x,y) (((x).expansions-(y).expansions)*100/((float)(x).expansions))
+#define IS_DELETED(i)       (deleted[i])
+#define LPA_H(l,i)          ((l)->ignore_heuristic ? 0 : \
+		heuristic_cost_estimate(state_space[i], state_space[(l)->goal]))
+#define MIN_OF(x,y)         (((x) < (y)) ? (x) : (y))
+#define LPA_KEY_LESS(a1,a2,b1,b2) ((a1) < (b1) || ((a1) == (b1) && (a2) < (b2)))
 
 typedef enum search_type_e search_type_t;
-enum search_type_e {A_STAR, UCS};
-
-typedef struct node_s node_t;
-struct node_s {
-	node_t *came_from;
-	float   g;
-	float   e;
-	char    visited;
-	char   *vector;
+enum search_type_e {A_STAR, UCS, LPA_STAR, BEAM};
+
+/*
+ * Beam frontier entry: a state with the e it was queued with. Entries of
+ * states queued again on a cheaper path, or already taken out, are stale.
+ */
+typedef struct beam_entry_s beam_entry_t;
+struct beam_entry_s {
+	float    e;
+	uint32_t seq;
+	uint32_t state;
+};
+
+typedef struct adj_list_s adj_list_t;
+struct adj_list_s {
+	int *index;
+	int  size;
+	int  capacity;
+};
+
+typedef struct lpa_search_s lpa_search_t;
+struct lpa_search_s {
+	int     source;
+	int     goal;
+	float  *g;
+	float  *rhs;
+	float  *k1;
+	float  *k2;
+	int    *heap;
+	int    *heap_pos;
+	int     heap_size;
+	int     capacity;
+	int     expansions;
+	int     ignore_heuristic;
+};
+
+typedef struct query_s query_t;
+struct query_s {
+	int           source;
+	int           goal;
+	search_type_t search_type;
+	int           valid;
+};
+
+typedef struct query_batch_s query_batch_t;
+struct query_batch_s {
+	query_t queries[STREAM_BATCH_SIZE];
+	int     size;
+};
+
+typedef struct output_batch_s output_batch_t;
+struct output_batch_s {
+	char buf[STREAM_BATCH_SIZE * STREAM_RECORD_SIZE];
+	int  size;
 };
 
-typedef struct set_node_s set_node_t;
-struct set_node_s {
-	node_t     *node;
-	set_node_t *next;
-	set_node_t *prev;
+/* Bounded, blocking FIFO of batches between two pipeline stages */
+typedef struct pipe_queue_s pipe_queue_t;
+struct pipe_queue_s {
+	void           *items[PIPE_CAPACITY];
+	int             head;
+	int             size;
+	pthread_mutex_t lock;
+	pthread_cond_t  not_empty;
+	pthread_cond_t  not_full;
 };
 
 typedef struct search_solution_s search_solution_t;
 struct search_solution_s {
-	node_t        *source;
-	node_t        *goal;
-	set_node_t    *reverse_path;
+	int            source;
+	int            goal;
+	uint32_t      *reverse_path;
+	int            path_length;
 	int            expansions;
 	float          total_cost;
 	search_type_t  search_type;
+	int            dropped;
+	int            proven_optimal;
 };
 
 /* Function prototypes */
@@ -83,54 +160,145 @@ void        alloc_node_array(void);
 void        print_node_array(void);
 void        free_state_space(int nrows);
 void        free_node_array(void);
-void        read_state(char *sname, node_t **nptr);
+void        read_state(char *sname, int *sptr);
 int         unique_state(int sindex);
-node_t     *alloc_node(char *vector);
 float       heuristic_cost_estimate(char *v0, char *v1);
 int         is_neighbor(char *x, char *y);
-set_node_t *get_neighbors(node_t *node);
-void        a_star(node_t *source, node_t *goal, search_solution_t *solution,
+void        a_star(int source, int goal, search_solution_t *solution,
 		   int ignore_heuristic);
 void        print_search_solution_info(search_solution_t *s);
 void        compare_search_solutions(search_solution_t x,
 		search_solution_t y);
-void        set_append(set_node_t **head, int *size, node_t *new_node);
-int         set_contains(set_node_t **head, node_t *node);
-void        free_set(set_node_t *head);
-node_t     *set_pop_min_e(set_node_t **head, int *size);
-node_t     *set_delete(set_node_t **head);
-set_node_t *reconstruct_path(node_t *goal);
-void        print_path_reverse(set_node_t *set_head);
+void        frontier_push(uint32_t u);
+uint32_t    frontier_pop(void);
+void        frontier_sift_up(int pos);
+void        frontier_sift_down(int pos);
+void        alloc_beam(void);
+void        beam_search(int source, int goal, search_solution_t *solution);
+float       beam_push(uint32_t u);
+int         beam_pop(beam_entry_t *x);
+void        beam_heap_insert(beam_entry_t x);
+beam_entry_t beam_heap_remove(int max);
+void        beam_heap_bubble_up(int pos);
+void        beam_heap_trickle_down(int pos);
+void        reconstruct_path(uint32_t goal, search_solution_t *solution);
+void        print_path_reverse(search_solution_t *s);
 void        reset_state_space(void);
 void        free_search_solution(search_solution_t *s);
 void        free_memory(void);
+void        build_adjacency(void);
+void        adj_append(adj_list_t *list, int sindex);
+void        adj_remove(adj_list_t *list, int sindex);
+void        grow_state_space(void);
+int         valid_vector(char *vector);
+int         insert_state(char *vector);
+int         delete_state(int sindex, adj_list_t *former);
+void        replan_session(void);
+void        lpa_init(lpa_search_t *l, int source, int goal,
+		int ignore_heuristic);
+void        lpa_reserve(lpa_search_t *l);
+void        lpa_update_vertex(lpa_search_t *l, int u);
+void        lpa_compute_shortest_path(lpa_search_t *l);
+void        lpa_state_inserted(lpa_search_t *l, int sindex);
+void        lpa_state_deleted(lpa_search_t *l, int sindex, adj_list_t *former);
+void        lpa_solution(lpa_search_t *l, search_solution_t *solution);
+void        lpa_heap_remove(lpa_search_t *l, int u);
+void        lpa_heap_push(lpa_search_t *l, int u);
+int         lpa_heap_pop(lpa_search_t *l);
+void        lpa_heap_sift(lpa_search_t *l, int pos);
+void        free_lpa_search(lpa_search_t *l);
+void        query_stream(char *path);
+void       *stream_reader(void *arg);
+void       *stream_writer(void *arg);
+int         parse_query(char *line, query_t *q);
+void        pipe_init(pipe_queue_t *q);
+void        pipe_push(pipe_queue_t *q, void *item);
+void       *pipe_pop(pipe_queue_t *q);
+void        pipe_destroy(pipe_queue_t *q);
 #ifdef USE_GRAPHVIZ
 void        produce_gv_graph(void);
 #endif
 
 /* Global data */
-int      L, M, d, N;
-char   **state_space;
-node_t **nodes;
-node_t  *source, *g1, *g2;
-search_solution_t s0, s1, s2, s3;
+int      L, M, d, N,
+	 state_capacity,
+	 replan_mode,
+	 beam_width,
+	 beam_per_depth;
+char    *query_path;
+char   **state_space,
+	*deleted;
+int      source = -1, g1 = -1, g2 = -1;
+adj_list_t *adjacency;
+
+/* Node table: search bookkeeping, indexed by state index */
+float         *g, *f;
+uint32_t      *parent, *seq, *frontier, *frontier_pos;
+unsigned char *flags;
+int            frontier_size;
+uint32_t       frontier_seq;
+
+/* Beam frontier: a min-max heap and a layer of beam_width entries each */
+beam_entry_t  *beam_heap;
+uint32_t      *beam_layer;
+int            beam_size;
+lpa_search_t lpa1, lpa2;
+search_solution_t s0, s1, s2, s3, r1, r2, b1, b2;
 
 
 int main(int argc, char **argv)
 {
-	if (argc != 5)
-		ERROR_EXIT("USAGE: %s L M d N\n", argv[0]);
+	int          opt;
+	unsigned int seed = time(NULL);
+
+	while ((opt = getopt(argc, argv, "rq:s:k:l")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r':
+				replan_mode = 1;
+				break;
+			case 'q':
+				query_path = optarg;
+				break;
+			case 's':
+				seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'k':
+				if ((beam_width = atoi(optarg)) <= 0)
+					ERROR_EXIT("k: should be at least 1\n");
+				break;
+			case 'l':
+				beam_per_depth = 1;
+				break;
+			default:
+				ERROR_EXIT(USAGE, argv[0]);
+		}
+	}
+	if (argc - optind != 4 || (beam_per_depth && !beam_width))
+		ERROR_EXIT(USAGE, argv[0]);
 
 	atexit(&free_memory);
 
-	get_args(argv);
+	get_args(argv + optind - 1);
 
 	/* Initialize pseudo-random number generator */
-	srand(time(NULL));
+	srand(seed);
 
 	alloc_state_space();
-	print_state_space();
 	alloc_node_array();
+	build_adjacency();
+
+	if (beam_width)
+		alloc_beam();
+
+	if (query_path)
+	{
+		query_stream(query_path);
+		return EXIT_SUCCESS;
+	}
+
+	print_state_space();
 
 #ifdef USE_GRAPHVIZ
 	produce_gv_graph();
@@ -141,9 +309,9 @@ int main(int argc, char **argv)
 	read_state("Goal #2", &g2);
 
 	printf("\n");
-	printf("Source:  %s\n", source->vector);
-	printf("Goal #1: %s\n", g1->vector);
-	printf("Goal #2: %s\n", g2->vector);
+	printf("Source:  %s\n", state_space[source]);
+	printf("Goal #1: %s\n", state_space[g1]);
+	printf("Goal #2: %s\n", state_space[g2]);
 
 	UCS(source, g1, &s0);
 	UCS(source, g2, &s1);
@@ -156,13 +324,21 @@ int main(int argc, char **argv)
 	print_search_solution_info(&s2);
 	print_search_solution_info(&s3);
 
+	if (beam_width)
+	{
+		beam_search(source, g1, &b1);
+		beam_search(source, g2, &b2);
+		print_search_solution_info(&b1);
+		print_search_solution_info(&b2);
+	}
+
 	printf("\n\n######################################################\n");
 	printf(    "#    Conclusion - Solution Comparison                #\n");
 	printf(    "######################################################\n");
 	if (s0.total_cost == -1 && s1.total_cost == -1)
 		printf("No path exists from %s to %s or to %s\n\n",
-				s0.source->vector, s0.goal->vector,
-				s1.goal->vector);
+				state_space[s0.source], state_space[s0.goal],
+				state_space[s1.goal]);
 	else if ((s0.total_cost < s1.total_cost && s0.total_cost != -1) ||
 			s1.total_cost == -1)
 		compare_search_solutions(s0, s2);
@@ -175,6 +351,9 @@ int main(int argc, char **argv)
 		compare_search_solutions(s1, s3);
 	};
 
+	if (replan_mode)
+		replan_session();
+
 	return EXIT_SUCCESS;
 }
 
@@ -189,7 +368,7 @@ void compare_search_solutions(search_solution_t x, search_solution_t y)
 		ERROR_RETURNV("compare_search_solutions(): Source and goal "
 				"states of the two solutions should match\n");
 	printf("Shortest path exists between %s and %s (Total cost: %.1f)\n",
-			x.source->vector, x.goal->vector, x.total_cost);
+			state_space[x.source], state_space[x.goal], x.total_cost);
 	printf("State expansions for UCS=%d and for A*=%d (%.2f%% reduction)\n\n",
 			x.expansions, y.expansions, EXPANSION_PERC(x,y));
 }
@@ -233,11 +412,13 @@ void alloc_state_space(void)
 		ERROR_RETURNV("State space is already allocated\n");
 
 	space = state_space = (char **) malloc(N * sizeof(char *));
-	if (!space)
+	deleted = (char *) calloc(N, sizeof(char));
+	if (!space || !deleted)
 	{
 		perror("malloc");
 		exit(errno);
 	}
+	state_capacity = N;
 
 	for (i = 0; i < N; i++)
 	{
@@ -268,6 +449,8 @@ void print_state_space(void)
 
 	for (i = 0; i < N; i++)
 	{
+		if (IS_DELETED(i))
+			continue;
 #if 1
 		printf("%-4d: ", i+1);
 #endif
@@ -282,15 +465,27 @@ void print_state_space(void)
 }
 
 
+/*
+ * Allocates the node table once per state space: one dense array per
+ * field, so that a relaxation touches consecutive memory instead of
+ * individually allocated nodes.
+ */
 void alloc_node_array(void)
 {
-	node_t **narray = (node_t **) calloc(N, sizeof(node_t *));
-	if (!narray)
+	g        = (float *) malloc(state_capacity * sizeof(float));
+	f        = (float *) malloc(state_capacity * sizeof(float));
+	parent   = (uint32_t *) malloc(state_capacity * sizeof(uint32_t));
+	seq      = (uint32_t *) malloc(state_capacity * sizeof(uint32_t));
+	frontier = (uint32_t *) malloc(state_capacity * sizeof(uint32_t));
+	frontier_pos = (uint32_t *) malloc(state_capacity * sizeof(uint32_t));
+	flags    = (unsigned char *) malloc(state_capacity * sizeof(char));
+	if (!g || !f || !parent || !seq || !frontier || !frontier_pos || !flags)
 	{
-		perror("calloc");
+		perror("malloc");
 		exit(errno);
 	}
-	nodes = narray;
+	memset(flags, 0, state_capacity * sizeof(char));
+	reset_state_space();
 }
 
 
@@ -298,11 +493,13 @@ void print_node_array(void)
 {
 	int i;
 
-	if (!nodes)
+	if (!flags)
 		ERROR_RETURNV("Nodes array has not yet been allocated\n");
 
 	for (i = 0; i < N; i++)
-		printf("%-4d - %p\n", i+1, nodes[i]);
+		printf("%-4d - g: %.1f f: %.1f parent: %d flags: %x\n", i+1,
+				g[i], f[i], (parent[i] == NO_PARENT) ?
+				0 : (int) parent[i] + 1, flags[i]);
 }
 
 
@@ -314,18 +511,24 @@ void free_state_space(int nrows)
 	for (i = 0; i <= nrows; i++)
 		free(state_space[i]);
 	free(state_space);
+	free(deleted);
+	if (!adjacency)
+		return;
+	for (i = 0; i <= nrows; i++)
+		free(adjacency[i].index);
+	free(adjacency);
 }
 
 
 void free_node_array(void)
 {
-	int i;
-	if (!nodes)
-		return;
-	for (i = 0; i < N; i++)
-		if (nodes[i])
-			free(nodes[i]);
-	free(nodes);
+	free(g);
+	free(f);
+	free(parent);
+	free(seq);
+	free(frontier);
+	free(frontier_pos);
+	free(flags);
 }
 
 
@@ -337,16 +540,16 @@ int unique_state(int sindex)
 		ERROR_EXIT("State space has not yet been allocated\n");
 
 	for (i = 0; i < sindex; i++)
-		if (strncmp(state_space[i], state_space[sindex], d) == 0)
+		if (!IS_DELETED(i) &&
+				strncmp(state_space[i], state_space[sindex], d) == 0)
 			return 0;
 	return 1;
 }
 
 
-void read_state(char *sname, node_t **nptr)
+void read_state(char *sname, int *sptr)
 {
-	int     x = -1, alloc = 1;
-	node_t *tmp_node;
+	int     x = -1;
 
 	if (!state_space)
 		ERROR_RETURNV("State space has not yet been allocated!\n");
@@ -364,18 +567,10 @@ void read_state(char *sname, node_t **nptr)
 		}
 		while (1);
 
-		if (alloc)
-		{
-			tmp_node = alloc_node(state_space[x-1]);
-			alloc = 0;
-		}
-		else
-			tmp_node->vector = state_space[x-1];
-
-		if (nodes[x-1])
+		if (x-1 == source || x-1 == g1 || x-1 == g2)
 		{
 			ERROR("State #%d is already used as %s state!\n",
-				x, (nodes[x-1] == source) ? "source" : "goal");
+				x, (x-1 == source) ? "source" : "goal");
 			ERROR("Please try again...\n");
 		}
 		else
@@ -383,23 +578,7 @@ void read_state(char *sname, node_t **nptr)
 	}
 	while (1);
 
-	*nptr = nodes[x-1] = tmp_node;
-}
-
-
-node_t *alloc_node(char *vector)
-{
-	node_t *new_node;
-	new_node = (node_t *) malloc(sizeof(node_t));
-	if (!new_node)
-	{
-		perror("malloc");
-		exit(errno);
-	}
-	new_node->vector = vector;
-	new_node->visited = 0;
-	new_node->g = new_node->e = -1;
-	return new_node;
+	*sptr = x-1;
 }
 
 
@@ -425,59 +604,37 @@ int is_neighbor(char *x, char *y)
 }
 
 
-set_node_t *get_neighbors(node_t *node)
-{
-	node_t *tmp_node;
-	set_node_t *neighbors = NULL;
-	int i, size;
-
-	for (i = 0; i < N; i++)
-	{
-		if (is_neighbor(node->vector, state_space[i]))
-		{
-			if (!nodes[i])
-				tmp_node = nodes[i] = alloc_node(state_space[i]);
-			else
-				tmp_node = nodes[i];
-			set_append(&neighbors, &size, tmp_node);
-		}
-	}
-	return neighbors;
-}
-
-
-void a_star(node_t *source, node_t *goal, search_solution_t *solution,
+void a_star(int source, int goal, search_solution_t *solution,
 		int ignore_heuristic)
 {
-	node_t     *currnode,
-	           *neighbor_node;
-	set_node_t *frontier = NULL,
-	           *neighbor_list = NULL;
+	adj_list_t *adj;
+	uint32_t    currnode,
+	            neighbor_node;
 	float       new_cost;
-	int         frontier_size,
+	int         i,
 		    expansions = 0;
 
 #ifdef DEBUG_L0
 	printf("\n######################################################");
-	printf("\n#    Search from %s to %s", source->vector, goal->vector);
+	printf("\n#    Search from %s to %s", state_space[source],
+			state_space[goal]);
 	printf("\n######################################################\n");
 #endif
-	source->g = 0;
-	source->e = _H(source, goal);
-
-	set_append(&frontier, &frontier_size, source);
-	source->came_from = source;
+	g[source] = 0;
+	f[source] = _H(source, goal);
+	parent[source] = source;
+	frontier_push(source);
 
 	while (frontier_size > 0)
 	{
 #ifdef DEBUG_L0
 		printf("Visit node (fs: %d): ", frontier_size);
 #endif
-		currnode = set_pop_min_e(&frontier, &frontier_size);
+		currnode = frontier_pop();
 #ifdef DEBUG_L0
-		printf("%s\n", currnode->vector);
+		printf("%s\n", state_space[currnode]);
 #endif
-		currnode->visited = 1;
+		flags[currnode] |= FLAG_VISITED;
 		expansions++;
 		if (currnode == goal)
 		{
@@ -487,48 +644,51 @@ void a_star(node_t *source, node_t *goal, search_solution_t *solution,
 			solution->source     = source;
 			solution->goal       = goal;
 			solution->expansions = expansions;
-			solution->total_cost = currnode->came_from->g +
-				               _G(currnode->came_from, currnode);
-			solution->reverse_path = reconstruct_path(currnode);
+			solution->total_cost = g[currnode];
+			reconstruct_path(currnode, solution);
 			solution->search_type = (ignore_heuristic) ? UCS : A_STAR;
+			solution->dropped    = 0;
+			solution->proven_optimal = 1;
 
-			free_set(frontier);
-			free_set(neighbor_list);
 			reset_state_space();
 			return;
 		}
 
-		neighbor_list = get_neighbors(currnode);
+		adj = &adjacency[currnode];
 
 #ifdef DEBUG_L0
 		printf("process neighbors start\n");
 #endif
-		while ((neighbor_node = set_delete(&neighbor_list)) != NULL)
+		for (i = 0; i < adj->size; i++)
 		{
+			neighbor_node = adj->index[i];
 			if (IN_CLOSEDSET(neighbor_node))
 				continue;
 #ifdef DEBUG_L0
-			printf("\tprocess neighbor %s\n", neighbor_node->vector);
+			printf("\tprocess neighbor %s\n", state_space[neighbor_node]);
 #endif
-			new_cost = currnode->g + _G(currnode, neighbor_node);
+			new_cost = g[currnode] + _G(currnode, neighbor_node);
 #ifdef DEBUG_L1
 			printf("\tnew_cost (%f) = curr->g (%f) + g(curr-neigh) (%f)\n",
-					new_cost, currnode->g, _G(currnode, neighbor_node));
+					new_cost, g[currnode],
+					_G(currnode, neighbor_node));
 #endif
-			if (!set_contains(&frontier, neighbor_node))
-				set_append(&frontier, &frontier_size, neighbor_node);
-			else if (new_cost >= neighbor_node->g)
+			if (IN_FRONTIER(neighbor_node) && new_cost >= g[neighbor_node])
 				continue;
-			neighbor_node->came_from = currnode;
-			neighbor_node->g = new_cost;
+			parent[neighbor_node] = currnode;
+			g[neighbor_node] = new_cost;
 			if (ignore_heuristic)
-				neighbor_node->e = neighbor_node->g;
+				f[neighbor_node] = g[neighbor_node];
 			else
-				neighbor_node->e = new_cost + _H(neighbor_node, goal);
+				f[neighbor_node] = new_cost + _H(neighbor_node, goal);
 #ifdef DEBUG_L1
-			printf("\te (%f) = %f + %f\n", neighbor_node->e, neighbor_node->g,
-					_H(neighbor_node, goal));
+			printf("\te (%f) = %f + %f\n", f[neighbor_node],
+					g[neighbor_node], _H(neighbor_node, goal));
 #endif
+			if (!IN_FRONTIER(neighbor_node))
+				frontier_push(neighbor_node);
+			else
+				frontier_sift_up(frontier_pos[neighbor_node]);
 		}
 #ifdef DEBUG_L0
 		printf("process neighbors end\n");
@@ -536,17 +696,18 @@ void a_star(node_t *source, node_t *goal, search_solution_t *solution,
 	}
 #ifdef DEBUG_L0
 	printf("\nStates: %s and %s are NOT connected!\n",
-			source->vector, goal->vector);
+			state_space[source], state_space[goal]);
 #endif
 	solution->source       = source;
 	solution->goal         = goal;
 	solution->expansions   = expansions;
 	solution->total_cost   = -1;
 	solution->reverse_path = NULL;
+	solution->path_length  = 0;
 	solution->search_type  = (ignore_heuristic) ? UCS : A_STAR;
+	solution->dropped      = 0;
+	solution->proven_optimal = 1;
 
-	free_set(frontier);
-	free_set(neighbor_list);
 	reset_state_space();
 }
 
@@ -556,191 +717,412 @@ void print_search_solution_info(search_solution_t *s)
 
 	char *search_name = (s->search_type == A_STAR) ?
 		                  "A-star (A*)" :
+		            (s->search_type == LPA_STAR) ?
+		                  "Lifelong Planning A* (LPA*)" :
+		            (s->search_type == BEAM) ?
+		                  ((beam_per_depth) ? "Beam (per depth)" :
+		                   "Bounded Frontier A*") :
 		                  "Uniform Cost";
 	printf("\n######################################################");
-	printf("\n#    %s Search from %s to %s", search_name, s->source->vector,
-			s->goal->vector);
+	printf("\n#    %s Search from %s to %s", search_name,
+			state_space[s->source], state_space[s->goal]);
 	printf("\n######################################################\n");
 
-	if (!s->reverse_path)
+	if (!s->reverse_path && s->proven_optimal)
 	{
 		printf("\nStates: %s and %s are NOT connected!\n",
-				s->source->vector, s->goal->vector);
+				state_space[s->source], state_space[s->goal]);
 		return;
 	}
-	print_path_reverse(s->reverse_path);
+	if (!s->reverse_path)
+		printf("\nNo path found within the frontier bound\n");
+	else
+		print_path_reverse(s);
 	printf("\nNumber of state expansions: %d\n", s->expansions);
-	printf("Total (actual) path cost:   %.1f\n", s->total_cost);
+	if (s->reverse_path)
+		printf("Total (actual) path cost:   %.1f\n", s->total_cost);
+	if (s->search_type != BEAM)
+		return;
+	printf("Frontier bound (k):         %d\n", beam_width);
+	printf("Dropped frontier entries:   %d\n", s->dropped);
+	printf("Provably optimal:           %s\n",
+			(s->proven_optimal) ? "yes" : "no");
 }
 
 
-void set_append(set_node_t **head, int *size, node_t *node)
+/*
+ * The frontier is a binary heap of state indices ordered by f. Ties are
+ * broken by insertion order, i.e. the state that entered the frontier
+ * first is expanded first.
+ */
+void frontier_push(uint32_t u)
 {
-	set_node_t *new_set_node,
-		   *tmp_set_node;
+	flags[u] |= FLAG_FRONTIER;
+	seq[u] = frontier_seq++;
+	frontier[frontier_size] = u;
+	frontier_pos[u] = frontier_size;
+	frontier_sift_up(frontier_size++);
+}
 
-	if (!head)
-		return;
 
-	new_set_node = (set_node_t *) malloc(sizeof(set_node_t));
-	if (!new_set_node)
+uint32_t frontier_pop(void)
+{
+	uint32_t retval = frontier[0];
+
+	flags[retval] &= ~FLAG_FRONTIER;
+	if (--frontier_size > 0)
 	{
-		perror("malloc");
-		exit(errno);
+		frontier[0] = frontier[frontier_size];
+		frontier_pos[frontier[0]] = 0;
+		frontier_sift_down(0);
 	}
-	new_set_node->node = node;
-	new_set_node->next = NULL;
+	return retval;
+}
 
-	if (!(*head))
+
+void frontier_sift_up(int pos)
+{
+	uint32_t u = frontier[pos];
+	int      up;
+
+	while (pos > 0)
 	{
-		*head = new_set_node;
-		new_set_node->prev = NULL;
-		*size = 1;
-		return;
+		up = (pos - 1) / 2;
+		if (!FRONTIER_LESS(u, frontier[up]))
+			break;
+		frontier[pos] = frontier[up];
+		frontier_pos[frontier[pos]] = pos;
+		pos = up;
 	}
-
-	tmp_set_node = *head;
-	while (tmp_set_node->next)
-		tmp_set_node = tmp_set_node->next;
-	tmp_set_node->next = new_set_node;
-	new_set_node->prev = tmp_set_node;
-	(*size)++;
+	frontier[pos] = u;
+	frontier_pos[u] = pos;
 }
 
 
-int set_contains(set_node_t **head, node_t *node)
+void frontier_sift_down(int pos)
 {
-	set_node_t *tmp_set_node;
-
-	if (!head)
-		return 0;
-	if (!(*head))
-		return 0;
+	uint32_t u = frontier[pos];
+	int      child;
 
-	tmp_set_node = *head;
-	while (tmp_set_node)
+	while ((child = 2 * pos + 1) < frontier_size)
 	{
-		if (tmp_set_node->node == node)
-			return 1;
-		tmp_set_node = tmp_set_node->next;
+		if (child + 1 < frontier_size &&
+				FRONTIER_LESS(frontier[child+1], frontier[child]))
+			child++;
+		if (!FRONTIER_LESS(frontier[child], u))
+			break;
+		frontier[pos] = frontier[child];
+		frontier_pos[frontier[pos]] = pos;
+		pos = child;
 	}
+	frontier[pos] = u;
+	frontier_pos[u] = pos;
+}
 
-	return 0;
+
+/*
+ * Allocates the beam frontier once: it never holds more than beam_width
+ * entries, whatever the size of the state space.
+ */
+void alloc_beam(void)
+{
+	beam_heap  = (beam_entry_t *) malloc(beam_width * sizeof(beam_entry_t));
+	beam_layer = (uint32_t *) malloc(beam_width * sizeof(uint32_t));
+	if (!beam_heap || !beam_layer)
+	{
+		perror("malloc");
+		exit(errno);
+	}
 }
 
 
-node_t *set_delete(set_node_t **head)
+/*
+ * Beam search: a_star() with at most beam_width frontier entries, ranked
+ * by e = g + h. The frontier is expanded best first, or with -l one
+ * depth at a time, in which case the frontier holds the next depth and
+ * states are reopened when reached on a cheaper path. A state whose e
+ * is not below the cost of the best path to the goal found so far is
+ * neither queued nor expanded. When a state does not fit, the entry with
+ * the highest e, the new one included, is dropped; as the heuristic is
+ * consistent, a path that costs no more than the lowest e dropped is
+ * optimal, and if nothing was dropped and no path was found, none
+ * exists.
+ */
+void beam_search(int source, int goal, search_solution_t *solution)
 {
-	node_t     *retval;
-	set_node_t *tmp_set_node;
+	adj_list_t  *adj;
+	beam_entry_t best;
+	uint32_t     currnode,
+	             neighbor_node;
+	float        new_cost, e,
+	             dropped_e = INFINITY,
+	             bound = INFINITY;
+	int          i, j,
+		     layer_size,
+		     expansions = 0,
+		     dropped = 0;
+
+	free_search_solution(solution);
+	beam_size = 0;
+	g[source] = 0;
+	f[source] = _H(source, goal);
+	parent[source] = source;
+	if (source != goal)
+		beam_push(source);
+
+	while (beam_pop(&best))
+	{
+		if (!beam_per_depth && best.e >= bound)
+			break;
+		beam_layer[0] = best.state;
+		layer_size = 1;
+		while (beam_per_depth && beam_pop(&best))
+			beam_layer[layer_size++] = best.state;
 
-	if (!head)
-		return NULL;
-	if (!(*head))
-		return NULL;
+		for (j = 0; j < layer_size; j++)
+		{
+			currnode = beam_layer[j];
+			/* Reached on a path to the goal as cheap since queued */
+			if (f[currnode] >= bound)
+				continue;
+			if (!beam_per_depth)
+				flags[currnode] |= FLAG_VISITED;
+			expansions++;
+			adj = &adjacency[currnode];
+			for (i = 0; i < adj->size; i++)
+			{
+				neighbor_node = adj->index[i];
+				if (IN_CLOSEDSET(neighbor_node))
+					continue;
+				new_cost = g[currnode] + _G(currnode, neighbor_node);
+				if (REACHED(neighbor_node) &&
+						new_cost >= g[neighbor_node])
+					continue;
+				e = new_cost + _H(neighbor_node, goal);
+				if (e >= bound)
+					continue;
+				parent[neighbor_node] = currnode;
+				g[neighbor_node] = new_cost;
+				f[neighbor_node] = e;
+				/* The goal is never queued, it only bounds the rest */
+				if (neighbor_node == (uint32_t) goal)
+					bound = new_cost;
+				else if ((e = beam_push(neighbor_node)) != INFINITY)
+				{
+					dropped++;
+					dropped_e = MIN_OF(dropped_e, e);
+				}
+			}
+		}
+	}
 
-	retval = (*head)->node;
-	if (!((*head)->next))
+	solution->source       = source;
+	solution->goal         = goal;
+	solution->expansions   = expansions;
+	solution->search_type  = BEAM;
+	solution->dropped      = dropped;
+	solution->total_cost   = -1;
+	solution->reverse_path = NULL;
+	solution->path_length  = 0;
+	if (REACHED(goal))
 	{
-		free(*head);
-		*head = NULL;
-		return retval;
+		/* Sum the edges, as g may have dropped below a parent's */
+		reconstruct_path(goal, solution);
+		solution->total_cost = 0;
+		for (i = 1; i < solution->path_length; i++)
+			solution->total_cost +=
+				_G(solution->reverse_path[i-1],
+				   solution->reverse_path[i]);
 	}
+	solution->proven_optimal = (REACHED(goal)) ?
+		solution->total_cost <= dropped_e : dropped == 0;
 
-	tmp_set_node = *head;
-	*head = (*head)->next;
-	(*head)->prev = NULL;
-	free(tmp_set_node);
-	return retval;
+	reset_state_space();
 }
 
 
-node_t *set_pop_min_e(set_node_t **head, int *size)
+/*
+ * Queues u with e = f[u]. Any earlier entry of u turns stale. If the
+ * frontier already holds beam_width entries, the entry with the highest
+ * e (u included) is dropped. Returns the e of the dropped entry, or
+ * INFINITY if none was dropped.
+ */
+float beam_push(uint32_t u)
 {
-	node_t     *retval;
-	set_node_t *min_set_node,
-		   *tmp_set_node;
-
-	if (!head)
-		return NULL;
-	if (!(*head))
-		return NULL;
+	beam_entry_t x, worst;
 
-	if (!(*head)->next)
+	x.e = f[u];
+	x.seq = frontier_seq++;
+	x.state = u;
+	flags[u] |= FLAG_FRONTIER;
+	while (beam_size == beam_width)
 	{
-		retval = (*head)->node;
-		free(*head);
-		*head = NULL;
-		(*size)--;
-		return retval;
+		worst = beam_heap_remove(1);
+		if (BEAM_STALE(worst))
+			continue;
+		if (BEAM_LESS(worst, x))
+		{
+			beam_heap_insert(worst);
+			flags[u] &= ~FLAG_FRONTIER;
+			return x.e;
+		}
+		flags[worst.state] &= ~FLAG_FRONTIER;
+		beam_heap_insert(x);
+		return worst.e;
 	}
+	beam_heap_insert(x);
+	return INFINITY;
+}
 
-	min_set_node = *head;
-	tmp_set_node = (*head)->next;
 
-	do
+/*
+ * Takes the entry with the lowest e out of the frontier, discarding
+ * stale entries on the way. Returns 0 if no live entry was left.
+ */
+int beam_pop(beam_entry_t *x)
+{
+	while (beam_size > 0)
 	{
-		if (tmp_set_node->node->e < min_set_node->node->e)
-			min_set_node = tmp_set_node;
-		tmp_set_node = tmp_set_node->next;
+		*x = beam_heap_remove(0);
+		if (BEAM_STALE(*x))
+			continue;
+		flags[x->state] &= ~FLAG_FRONTIER;
+		return 1;
 	}
-	while (tmp_set_node);
+	return 0;
+}
 
-	if (min_set_node->prev)
-		min_set_node->prev->next = min_set_node->next;
-	else
-		*head = min_set_node->next;
 
-	if (min_set_node->next)
-		min_set_node->next->prev = min_set_node->prev;
-	retval = min_set_node->node;
-	free(min_set_node);
-	(*size)--;
+/*
+ * The beam frontier is a min-max heap: the levels alternate between
+ * entries no greater (even levels, the root included) and no smaller
+ * (odd levels) than their descendants, so that both ends are reached in
+ * O(log k).
+ */
+void beam_heap_insert(beam_entry_t x)
+{
+	beam_heap[beam_size] = x;
+	beam_heap_bubble_up(beam_size++);
+}
+
 
+beam_entry_t beam_heap_remove(int max)
+{
+	beam_entry_t retval;
+	int          pos = 0;
+
+	if (max && beam_size > 1)
+		pos = (beam_size > 2 &&
+				BEAM_LESS(beam_heap[1], beam_heap[2])) ? 2 : 1;
+	retval = beam_heap[pos];
+	if (--beam_size > pos)
+	{
+		beam_heap[pos] = beam_heap[beam_size];
+		beam_heap_trickle_down(pos);
+	}
 	return retval;
 }
 
-void free_set(set_node_t *head)
+
+void beam_heap_bubble_up(int pos)
 {
-	set_node_t *tmp_node;
+	beam_entry_t x = beam_heap[pos];
+	int          max = MAX_LEVEL(pos), up;
 
-	while (head)
+	if (pos == 0)
+		return;
+	/* An entry beyond its parent belongs to the parent's levels */
+	up = (pos - 1) / 2;
+	if (BEAM_BEFORE(beam_heap[up], x, max))
+	{
+		beam_heap[pos] = beam_heap[up];
+		pos = up;
+		max = !max;
+	}
+	/* Then it moves up through its grandparents */
+	while (pos > 2 && BEAM_BEFORE(x, beam_heap[((pos-1)/2 - 1) / 2], max))
 	{
-		tmp_node = head->next;
-		free(head);
-		head = tmp_node;
+		up = ((pos - 1) / 2 - 1) / 2;
+		beam_heap[pos] = beam_heap[up];
+		pos = up;
 	}
+	beam_heap[pos] = x;
 }
 
 
-set_node_t *reconstruct_path(node_t *goal)
+void beam_heap_trickle_down(int pos)
 {
-	node_t *tmp_node = goal;
-	set_node_t *rpath = NULL;
-	int path_size;
+	beam_entry_t x = beam_heap[pos], tmp;
+	int          max = MAX_LEVEL(pos), m, i;
 
-	while (tmp_node && tmp_node != tmp_node->came_from)
+	while (2 * pos + 1 < beam_size)
 	{
-		set_append(&rpath, &path_size, tmp_node);
-		tmp_node = tmp_node->came_from;
+		/* The first among the children and grandchildren */
+		m = 2 * pos + 1;
+		if (m + 1 < beam_size &&
+				BEAM_BEFORE(beam_heap[m+1], beam_heap[m], max))
+			m++;
+		for (i = 4 * pos + 3; i < 4 * pos + 7 && i < beam_size; i++)
+			if (BEAM_BEFORE(beam_heap[i], beam_heap[m], max))
+				m = i;
+		if (!BEAM_BEFORE(beam_heap[m], x, max))
+			break;
+		beam_heap[pos] = beam_heap[m];
+		/* A child is on the other levels, where x stops */
+		if (m <= 2 * pos + 2)
+		{
+			pos = m;
+			break;
+		}
+		pos = m;
+		/* x goes on down its levels, past its new parent if need be */
+		if (BEAM_BEFORE(beam_heap[(m-1)/2], x, max))
+		{
+			tmp = beam_heap[(m-1)/2];
+			beam_heap[(m-1)/2] = x;
+			x = tmp;
+		}
 	}
-	set_append(&rpath, &path_size, tmp_node);
-	return rpath;
+	beam_heap[pos] = x;
 }
 
 
-void print_path_reverse(set_node_t *set_head)
+void reconstruct_path(uint32_t goal, search_solution_t *solution)
 {
-	set_node_t *tmp_set_node = set_head;
-	while (tmp_set_node->next)
-		tmp_set_node = tmp_set_node->next;
-	printf("Solution Path: ");
-	while (tmp_set_node->prev)
+	uint32_t tmp_node = goal;
+	int      path_size = 1;
+
+	while (tmp_node != parent[tmp_node])
+	{
+		tmp_node = parent[tmp_node];
+		path_size++;
+	}
+
+	solution->reverse_path = (uint32_t *) malloc(path_size * sizeof(uint32_t));
+	if (!solution->reverse_path)
+	{
+		perror("malloc");
+		exit(errno);
+	}
+	solution->path_length = path_size;
+
+	tmp_node = goal;
+	for (path_size = 0; path_size < solution->path_length; path_size++)
 	{
-		printf("%s -> ", tmp_set_node->node->vector);
-		tmp_set_node = tmp_set_node->prev;
+		solution->reverse_path[path_size] = tmp_node;
+		tmp_node = parent[tmp_node];
 	}
-	printf("%s\n", tmp_set_node->node->vector);
+}
+
+
+void print_path_reverse(search_solution_t *s)
+{
+	int i;
+
+	printf("Solution Path: ");
+	for (i = s->path_length - 1; i > 0; i--)
+		printf("%s -> ", state_space[s->reverse_path[i]]);
+	printf("%s\n", state_space[s->reverse_path[0]]);
 }
 
 
@@ -749,11 +1131,12 @@ void reset_state_space(void)
 	int i;
 	for (i = 0; i < N; i++)
 	{
-		if (!nodes[i])
-			continue;
-		nodes[i]->visited = 0;
-		nodes[i]->g = nodes[i]->e = -1;
+		flags[i] = 0;
+		g[i] = f[i] = -1;
+		parent[i] = NO_PARENT;
 	}
+	frontier_size = 0;
+	frontier_seq = 0;
 }
 
 
@@ -761,18 +1144,773 @@ void free_search_solution(search_solution_t *s)
 {
 	if (!s)
 		return;
-	free_set(s->reverse_path);
+	free(s->reverse_path);
+	s->reverse_path = NULL;
 }
 
 
 void free_memory(void)
 {
 	free_node_array();
+	free(beam_heap);
+	free(beam_layer);
 	free_state_space(N-1);
 	free_search_solution(&s0);
 	free_search_solution(&s1);
 	free_search_solution(&s2);
 	free_search_solution(&s3);
+	free_search_solution(&r1);
+	free_search_solution(&r2);
+	free_search_solution(&b1);
+	free_search_solution(&b2);
+	free_lpa_search(&lpa1);
+	free_lpa_search(&lpa2);
+}
+
+
+void build_adjacency(void)
+{
+	int i, j;
+
+	adjacency = (adj_list_t *) calloc(state_capacity, sizeof(adj_list_t));
+	if (!adjacency)
+	{
+		perror("calloc");
+		exit(errno);
+	}
+
+	for (i = 0; i < N; i++)
+		for (j = i+1; j < N; j++)
+			if (is_neighbor(state_space[i], state_space[j]))
+			{
+				adj_append(&adjacency[i], j);
+				adj_append(&adjacency[j], i);
+			}
+}
+
+
+void adj_append(adj_list_t *list, int sindex)
+{
+	int *new_index;
+
+	if (list->size == list->capacity)
+	{
+		list->capacity = (list->capacity) ? 2 * list->capacity : 4;
+		new_index = (int *) realloc(list->index,
+				list->capacity * sizeof(int));
+		if (!new_index)
+		{
+			perror("realloc");
+			exit(errno);
+		}
+		list->index = new_index;
+	}
+	list->index[list->size++] = sindex;
+}
+
+
+void adj_remove(adj_list_t *list, int sindex)
+{
+	int i;
+
+	for (i = 0; i < list->size; i++)
+		if (list->index[i] == sindex)
+		{
+			list->index[i] = list->index[--(list->size)];
+			return;
+		}
+}
+
+
+/*
+ * Doubles the capacity of every per-state array (state space, node
+ * table, adjacency lists and deletion flags). Indices of existing
+ * states remain stable, so solutions stay valid.
+ */
+void grow_state_space(void)
+{
+	int     new_capacity = 2 * state_capacity;
+	char  **new_space;
+	char   *new_deleted;
+	adj_list_t *new_adjacency;
+
+	new_space = (char **) realloc(state_space,
+			new_capacity * sizeof(char *));
+	if (new_space)
+		state_space = new_space;
+	new_deleted = (char *) realloc(deleted, new_capacity * sizeof(char));
+	if (new_deleted)
+		deleted = new_deleted;
+	new_adjacency = (adj_list_t *) realloc(adjacency,
+			new_capacity * sizeof(adj_list_t));
+	if (new_adjacency)
+		adjacency = new_adjacency;
+	if (!new_space || !new_deleted || !new_adjacency)
+	{
+		perror("realloc");
+		exit(errno);
+	}
+
+	memset(deleted + state_capacity, 0, new_capacity - state_capacity);
+	memset(adjacency + state_capacity, 0,
+			(new_capacity - state_capacity) * sizeof(adj_list_t));
+	state_capacity = new_capacity;
+
+	free_node_array();
+	alloc_node_array();
+}
+
+
+int valid_vector(char *vector)
+{
+	int i;
+
+	if ((int) strlen(vector) != d)
+		return 0;
+	for (i = 0; i < d; i++)
+	{
+		if (i < d/2 && (vector[i] < 'A' || vector[i] >= 'A' + L))
+			return 0;
+		if (i >= d/2 && (vector[i] < '1' || vector[i] >= '1' + M))
+			return 0;
+	}
+	return 1;
+}
+
+
+/*
+ * Appends a new state to the state space and links it with its
+ * neighbors. Only the adjacency lists of the new state and of its
+ * neighbors are touched. Returns the index of the new state or -1.
+ */
+int insert_state(char *vector)
+{
+	int i;
+
+	if (!valid_vector(vector))
+		return -1;
+
+	if (N == state_capacity)
+		grow_state_space();
+
+	state_space[N] = (char *) malloc((d+1) * sizeof(char));
+	if (!state_space[N])
+	{
+		perror("malloc");
+		exit(errno);
+	}
+	strncpy(state_space[N], vector, d+1);
+	deleted[N] = 0;
+	if (!unique_state(N))
+	{
+		free(state_space[N]);
+		return -1;
+	}
+
+	for (i = 0; i < N; i++)
+		if (!IS_DELETED(i) && is_neighbor(state_space[i], vector))
+		{
+			adj_append(&adjacency[i], N);
+			adj_append(&adjacency[N], i);
+		}
+	return N++;
+}
+
+
+/*
+ * Removes a state from the state space by unlinking it from its
+ * neighbors. The slot is kept, so that indices and previously returned
+ * paths remain valid. The former neighbors are
+ * returned through 'former', which the caller has to free.
+ */
+int delete_state(int sindex, adj_list_t *former)
+{
+	int i;
+
+	if (sindex < 0 || sindex >= N || IS_DELETED(sindex))
+		return -1;
+	if (sindex == source || sindex == g1 || sindex == g2)
+		return -1;
+
+	for (i = 0; i < adjacency[sindex].size; i++)
+		adj_remove(&adjacency[adjacency[sindex].index[i]], sindex);
+	*former = adjacency[sindex];
+	memset(&adjacency[sindex], 0, sizeof(adj_list_t));
+	deleted[sindex] = 1;
+	return 0;
+}
+
+
+void replan_session(void)
+{
+	char       cmd, vector[64];
+	int        x;
+	adj_list_t former;
+
+	printf("\n\n######################################################\n");
+	printf(    "#    Replanning - Edit State Space                   #\n");
+	printf(    "######################################################\n");
+
+	lpa_init(&lpa1, source, g1, 0);
+	lpa_init(&lpa2, source, g2, 0);
+	lpa_solution(&lpa1, &r1);
+	lpa_solution(&lpa2, &r2);
+	print_search_solution_info(&r1);
+	print_search_solution_info(&r2);
+
+	do
+	{
+		printf("\nEnter edit (+ VECTOR: insert, - INDEX: delete, "
+				"q: quit): ");
+		if (scanf(" %c", &cmd) != 1 || cmd == 'q')
+			break;
+		if (cmd == '+')
+		{
+			if (scanf("%63s", vector) != 1 ||
+					(x = insert_state(vector)) == -1)
+			{
+				ERROR("Invalid or duplicate state\n");
+				continue;
+			}
+			printf("Inserted state #%d: %s\n", x+1, state_space[x]);
+			lpa_state_inserted(&lpa1, x);
+			lpa_state_inserted(&lpa2, x);
+		}
+		else if (cmd == '-')
+		{
+			if (scanf("%d", &x) != 1 || delete_state(x-1, &former))
+			{
+				ERROR("Invalid state or state in use\n");
+				continue;
+			}
+			printf("Deleted state #%d: %s\n", x, state_space[x-1]);
+			lpa_state_deleted(&lpa1, x-1, &former);
+			lpa_state_deleted(&lpa2, x-1, &former);
+			free(former.index);
+		}
+		else
+		{
+			ERROR("Unknown edit '%c'\n", cmd);
+			continue;
+		}
+		lpa_solution(&lpa1, &r1);
+		lpa_solution(&lpa2, &r2);
+		print_search_solution_info(&r1);
+		print_search_solution_info(&r2);
+	}
+	while (1);
+}
+
+
+/*
+ * Lifelong Planning A* (Koenig & Likhachev). Per-state g/rhs values
+ * survive between searches, so after an edit only the states whose
+ * shortest path distance changed are expanded again.
+ */
+void lpa_init(lpa_search_t *l, int source, int goal,
+		int ignore_heuristic)
+{
+	memset(l, 0, sizeof(lpa_search_t));
+	l->source = source;
+	l->goal = goal;
+	l->ignore_heuristic = ignore_heuristic;
+	lpa_reserve(l);
+	l->rhs[source] = 0;
+	lpa_heap_push(l, source);
+	lpa_compute_shortest_path(l);
+}
+
+
+void lpa_reserve(lpa_search_t *l)
+{
+	int i;
+
+	if (l->capacity >= state_capacity)
+		return;
+
+	l->g        = (float *) realloc(l->g,   state_capacity * sizeof(float));
+	l->rhs      = (float *) realloc(l->rhs, state_capacity * sizeof(float));
+	l->k1       = (float *) realloc(l->k1,  state_capacity * sizeof(float));
+	l->k2       = (float *) realloc(l->k2,  state_capacity * sizeof(float));
+	l->heap     = (int *) realloc(l->heap,  state_capacity * sizeof(int));
+	l->heap_pos = (int *) realloc(l->heap_pos, state_capacity * sizeof(int));
+	if (!l->g || !l->rhs || !l->k1 || !l->k2 || !l->heap || !l->heap_pos)
+	{
+		perror("realloc");
+		exit(errno);
+	}
+	for (i = l->capacity; i < state_capacity; i++)
+	{
+		l->g[i] = l->rhs[i] = INFINITY;
+		l->heap_pos[i] = -1;
+	}
+	l->capacity = state_capacity;
+}
+
+
+void lpa_update_vertex(lpa_search_t *l, int u)
+{
+	adj_list_t *adj = &adjacency[u];
+	float       cost;
+	int         i, v;
+
+	if (u != l->source)
+	{
+		l->rhs[u] = INFINITY;
+		for (i = 0; i < adj->size; i++)
+		{
+			v = adj->index[i];
+			cost = l->g[v] + EDGE_COST(state_space[v], state_space[u]);
+			if (cost < l->rhs[u])
+				l->rhs[u] = cost;
+		}
+	}
+	lpa_heap_remove(l, u);
+	if (l->g[u] != l->rhs[u])
+		lpa_heap_push(l, u);
+}
+
+
+void lpa_compute_shortest_path(lpa_search_t *l)
+{
+	adj_list_t *adj;
+	int         u, i, t = l->goal;
+	float       gk1, gk2;
+
+	l->expansions = 0;
+	while (l->heap_size > 0)
+	{
+		gk2 = MIN_OF(l->g[t], l->rhs[t]);
+		gk1 = gk2 + LPA_H(l, t);
+		u = l->heap[0];
+		if (!LPA_KEY_LESS(l->k1[u], l->k2[u], gk1, gk2) &&
+				l->rhs[t] == l->g[t])
+			break;
+
+		lpa_heap_pop(l);
+		l->expansions++;
+		adj = &adjacency[u];
+		if (l->g[u] > l->rhs[u])
+			l->g[u] = l->rhs[u];
+		else
+		{
+			l->g[u] = INFINITY;
+			lpa_update_vertex(l, u);
+		}
+		for (i = 0; i < adj->size; i++)
+			lpa_update_vertex(l, adj->index[i]);
+	}
+}
+
+
+void lpa_state_inserted(lpa_search_t *l, int sindex)
+{
+	lpa_reserve(l);
+	lpa_update_vertex(l, sindex);
+	lpa_compute_shortest_path(l);
+}
+
+
+void lpa_state_deleted(lpa_search_t *l, int sindex, adj_list_t *former)
+{
+	int i;
+
+	lpa_reserve(l);
+	lpa_heap_remove(l, sindex);
+	l->g[sindex] = l->rhs[sindex] = INFINITY;
+	for (i = 0; i < former->size; i++)
+		lpa_update_vertex(l, former->index[i]);
+	lpa_compute_shortest_path(l);
+}
+
+
+/*
+ * Rebuilds the solution path by walking from the goal towards the source
+ * through the predecessor that minimizes g(v) + c(v,u).
+ */
+void lpa_solution(lpa_search_t *l, search_solution_t *solution)
+{
+	adj_list_t *adj;
+	int         u, v, i, best;
+	float       cost, best_cost;
+
+	free_search_solution(solution);
+	solution->source      = l->source;
+	solution->goal        = l->goal;
+	solution->expansions  = l->expansions;
+	solution->search_type = LPA_STAR;
+	solution->path_length = 0;
+	solution->dropped     = 0;
+	solution->proven_optimal = 1;
+
+	u = l->goal;
+	if (l->g[u] == INFINITY)
+	{
+		solution->total_cost = -1;
+		return;
+	}
+	solution->total_cost = l->g[u];
+
+	solution->reverse_path = (uint32_t *) malloc(N * sizeof(uint32_t));
+	if (!solution->reverse_path)
+	{
+		perror("malloc");
+		exit(errno);
+	}
+	solution->reverse_path[solution->path_length++] = u;
+	while (u != l->source && solution->path_length < N)
+	{
+		adj = &adjacency[u];
+		best = -1;
+		best_cost = INFINITY;
+		for (i = 0; i < adj->size; i++)
+		{
+			v = adj->index[i];
+			cost = l->g[v] + EDGE_COST(state_space[v], state_space[u]);
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best = v;
+			}
+		}
+		u = best;
+		solution->reverse_path[solution->path_length++] = u;
+	}
+}
+
+
+void lpa_heap_sift(lpa_search_t *l, int pos)
+{
+	int u = l->heap[pos], parent, child;
+
+	while (pos > 0)
+	{
+		parent = (pos - 1) / 2;
+		if (!LPA_KEY_LESS(l->k1[u], l->k2[u],
+				l->k1[l->heap[parent]], l->k2[l->heap[parent]]))
+			break;
+		l->heap[pos] = l->heap[parent];
+		l->heap_pos[l->heap[pos]] = pos;
+		pos = parent;
+	}
+	while ((child = 2 * pos + 1) < l->heap_size)
+	{
+		if (child + 1 < l->heap_size &&
+				LPA_KEY_LESS(l->k1[l->heap[child+1]],
+					l->k2[l->heap[child+1]],
+					l->k1[l->heap[child]],
+					l->k2[l->heap[child]]))
+			child++;
+		if (!LPA_KEY_LESS(l->k1[l->heap[child]], l->k2[l->heap[child]],
+				l->k1[u], l->k2[u]))
+			break;
+		l->heap[pos] = l->heap[child];
+		l->heap_pos[l->heap[pos]] = pos;
+		pos = child;
+	}
+	l->heap[pos] = u;
+	l->heap_pos[u] = pos;
+}
+
+
+void lpa_heap_push(lpa_search_t *l, int u)
+{
+	float m = MIN_OF(l->g[u], l->rhs[u]);
+
+	l->k1[u] = m + LPA_H(l, u);
+	l->k2[u] = m;
+	l->heap[l->heap_size] = u;
+	l->heap_pos[u] = l->heap_size++;
+	lpa_heap_sift(l, l->heap_pos[u]);
+}
+
+
+int lpa_heap_pop(lpa_search_t *l)
+{
+	int u = l->heap[0];
+
+	lpa_heap_remove(l, u);
+	return u;
+}
+
+
+void lpa_heap_remove(lpa_search_t *l, int u)
+{
+	int pos = l->heap_pos[u];
+
+	if (pos == -1)
+		return;
+	l->heap_pos[u] = -1;
+	if (--(l->heap_size) == pos)
+		return;
+	l->heap[pos] = l->heap[l->heap_size];
+	l->heap_pos[l->heap[pos]] = pos;
+	lpa_heap_sift(l, pos);
+}
+
+
+void free_lpa_search(lpa_search_t *l)
+{
+	free(l->g);
+	free(l->rhs);
+	free(l->k1);
+	free(l->k2);
+	free(l->heap);
+	free(l->heap_pos);
+}
+
+
+/*
+ * Non-interactive mode: answers "SOURCE GOAL ALGORITHM" queries (state
+ * indices in [1,N], algorithm "astar", "ucs" or, given -k, "beam") read
+ * from a file or from stdin ("-"). Parsing, searching and output run as
+ * a three-stage pipeline, so that the search thread never waits on I/O.
+ * Every query produces one record: "SOURCE GOAL ALGORITHM COST
+ * EXPANSIONS LENGTH", where COST is -1 for disconnected states (or, for
+ * beam, when no path was found), followed for beam by 1 if the result
+ * is provably optimal and 0 otherwise, or "SOURCE GOAL ERROR" for
+ * malformed queries.
+ */
+void query_stream(char *path)
+{
+	FILE              *infile;
+	pthread_t          reader, writer;
+	pipe_queue_t       in_queue, out_queue;
+	void              *reader_args[2];
+	query_batch_t     *qbatch;
+	output_batch_t    *obatch;
+	query_t           *q;
+	search_solution_t  s;
+	int                i, len;
+
+	if (strcmp(path, "-") == 0)
+		infile = stdin;
+	else if (!(infile = fopen(path, "r")))
+	{
+		perror("fopen");
+		exit(errno);
+	}
+
+	pipe_init(&in_queue);
+	pipe_init(&out_queue);
+	reader_args[0] = infile;
+	reader_args[1] = &in_queue;
+	if (pthread_create(&reader, NULL, &stream_reader, reader_args) ||
+			pthread_create(&writer, NULL, &stream_writer, &out_queue))
+		ERROR_EXIT("pthread_create: Error creating stream threads\n");
+
+	while ((qbatch = (query_batch_t *) pipe_pop(&in_queue)) != NULL)
+	{
+		obatch = (output_batch_t *) malloc(sizeof(output_batch_t));
+		if (!obatch)
+		{
+			perror("malloc");
+			exit(errno);
+		}
+		obatch->size = 0;
+
+		for (i = 0; i < qbatch->size; i++)
+		{
+			q = &qbatch->queries[i];
+			if (!q->valid)
+			{
+				len = snprintf(obatch->buf + obatch->size,
+						STREAM_RECORD_SIZE, "%d %d ERROR\n",
+						q->source, q->goal);
+				obatch->size += MIN_OF(len, STREAM_RECORD_SIZE - 1);
+				continue;
+			}
+			memset(&s, 0, sizeof(search_solution_t));
+			if (q->search_type == BEAM)
+				beam_search(q->source - 1, q->goal - 1, &s);
+			else
+				a_star(q->source - 1, q->goal - 1, &s,
+						q->search_type == UCS);
+			/* A truncated record must not leave a gap in buf */
+			len = snprintf(obatch->buf + obatch->size,
+					STREAM_RECORD_SIZE, "%d %d %s %.1f %d %d%s\n",
+					q->source, q->goal,
+					(q->search_type == UCS) ? "ucs" :
+					(q->search_type == BEAM) ? "beam" : "astar",
+					s.total_cost, s.expansions, s.path_length,
+					(q->search_type != BEAM) ? "" :
+					(s.proven_optimal) ? " 1" : " 0");
+			obatch->size += MIN_OF(len, STREAM_RECORD_SIZE - 1);
+			free_search_solution(&s);
+		}
+		free(qbatch);
+		pipe_push(&out_queue, obatch);
+	}
+	pipe_push(&out_queue, NULL);
+
+	pthread_join(reader, NULL);
+	pthread_join(writer, NULL);
+	pipe_destroy(&in_queue);
+	pipe_destroy(&out_queue);
+	if (infile != stdin)
+		fclose(infile);
+}
+
+
+void *stream_reader(void *arg)
+{
+	FILE          *infile = (FILE *) ((void **) arg)[0];
+	pipe_queue_t  *queue = (pipe_queue_t *) ((void **) arg)[1];
+	query_batch_t *batch = NULL;
+	char          *block, *line, *eol;
+	size_t         carry = 0, nread;
+
+	block = (char *) malloc(STREAM_BLOCK_SIZE + 1);
+	if (!block)
+	{
+		perror("malloc");
+		exit(errno);
+	}
+
+	do
+	{
+		nread = fread(block + carry, 1, STREAM_BLOCK_SIZE - carry, infile);
+		carry += nread;
+		block[carry] = '\0';
+		line = block;
+		while ((eol = strchr(line, '\n')) != NULL ||
+				(nread == 0 && *line != '\0'))
+		{
+			if (eol)
+				*eol = '\0';
+			if (!batch)
+			{
+				batch = (query_batch_t *) malloc(sizeof(query_batch_t));
+				if (!batch)
+				{
+					perror("malloc");
+					exit(errno);
+				}
+				batch->size = 0;
+			}
+			if (parse_query(line, &batch->queries[batch->size]))
+				batch->size++;
+			if (batch->size == STREAM_BATCH_SIZE)
+			{
+				pipe_push(queue, batch);
+				batch = NULL;
+			}
+			if (!eol)
+			{
+				line += strlen(line);
+				break;
+			}
+			line = eol + 1;
+		}
+		/* Keep the incomplete last line for the next block */
+		carry = block + carry - line;
+		if (carry == STREAM_BLOCK_SIZE)
+		{
+			ERROR("Query line too long, skipping\n");
+			carry = 0;
+		}
+		memmove(block, line, carry);
+	}
+	while (nread > 0);
+
+	if (batch && batch->size > 0)
+		pipe_push(queue, batch);
+	else
+		free(batch);
+	pipe_push(queue, NULL);
+	free(block);
+	return NULL;
+}
+
+
+void *stream_writer(void *arg)
+{
+	pipe_queue_t   *queue = (pipe_queue_t *) arg;
+	output_batch_t *batch;
+
+	while ((batch = (output_batch_t *) pipe_pop(queue)) != NULL)
+	{
+		if (fwrite(batch->buf, 1, batch->size, stdout) !=
+				(size_t) batch->size)
+			perror("fwrite");
+		free(batch);
+	}
+	fflush(stdout);
+	return NULL;
+}
+
+
+/*
+ * Returns 0 for blank lines, 1 otherwise. Out of range or malformed
+ * queries are returned with valid = 0, so that they get an error record.
+ */
+int parse_query(char *line, query_t *q)
+{
+	char algorithm[8];
+	int  n;
+
+	q->source = q->goal = 0;
+	n = sscanf(line, "%d %d %7s", &q->source, &q->goal, algorithm);
+	if (n == EOF)
+		return 0;
+	q->valid = (n == 3 && q->source >= 1 && q->source <= N &&
+			q->goal >= 1 && q->goal <= N);
+	if (!q->valid)
+		return 1;
+	if (strcmp(algorithm, "astar") == 0 || strcmp(algorithm, "a") == 0)
+		q->search_type = A_STAR;
+	else if (strcmp(algorithm, "ucs") == 0 || strcmp(algorithm, "u") == 0)
+		q->search_type = UCS;
+	else if (beam_width && (strcmp(algorithm, "beam") == 0 ||
+				strcmp(algorithm, "b") == 0))
+		q->search_type = BEAM;
+	else
+		q->valid = 0;
+	return 1;
+}
+
+
+void pipe_init(pipe_queue_t *q)
+{
+	q->head = q->size = 0;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->not_empty, NULL);
+	pthread_cond_init(&q->not_full, NULL);
+}
+
+
+void pipe_push(pipe_queue_t *q, void *item)
+{
+	pthread_mutex_lock(&q->lock);
+	while (q->size == PIPE_CAPACITY)
+		pthread_cond_wait(&q->not_full, &q->lock);
+	q->items[(q->head + q->size++) % PIPE_CAPACITY] = item;
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+}
+
+
+void *pipe_pop(pipe_queue_t *q)
+{
+	void *item;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->size == 0)
+		pthread_cond_wait(&q->not_empty, &q->lock);
+	item = q->items[q->head];
+	q->head = (q->head + 1) % PIPE_CAPACITY;
+	q->size--;
+	pthread_cond_signal(&q->not_full);
+	pthread_mutex_unlock(&q->lock);
+	return item;
+}
+
+
+void pipe_destroy(pipe_queue_t *q)
+{
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->not_empty);
+	pthread_cond_destroy(&q->not_full);
 }
 
 
@@ -791,10 +1929,13 @@ void produce_gv_graph(void)
 	fprintf(outfile, "strict graph {\n");
 	for (i = 0; i < N; i++)
 	{
+		if (IS_DELETED(i))
+			continue;
 		neighbor_count = 0;
 		for (j = 0; j < N; j++)
 		{
-			if (is_neighbor(state_space[i], state_space[j]))
+			if (!IS_DELETED(j) &&
+					is_neighbor(state_space[i], state_space[j]))
 			{
 				neighbor_count++;
 				if (i >= j)